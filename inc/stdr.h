@@ -7,15 +7,21 @@
 #include <string.h>     // memcpy, memcmp, strlen
 #include <sys/types.h>  // ssize_t
 
+#ifdef __SSE2__
+#include <emmintrin.h>  // _mm_cmpeq_epi8, _mm_movemask_epi8
+#endif
+
 #ifndef STDR_MALLOC
 
-#ifdef STDR_FREE
-#error "STDR_FREE must be defined with STDR_MALLOC"
+#if defined(STDR_FREE) || defined(STDR_REALLOC)
+#error "STDR_FREE and STDR_REALLOC must be defined with STDR_MALLOC"
 #endif
 
-#include <stdlib.h>  // malloc, free, qsort
+#include <stdlib.h>  // malloc, realloc, free, qsort
 #define STDR_MALLOC malloc
+#define STDR_REALLOC realloc
 #define STDR_FREE free
+#define STDR_DEFAULT_ALLOCATOR 1
 
 #else  // STDR_MALLOC
 
@@ -23,8 +29,17 @@
 #error "STDR_FREE must be defined with STDR_MALLOC"
 #endif  // STDR_FREE
 
+// STDR_REALLOC is optional. Without it arrays grow by copying.
+
 #endif  // STDR_MALLOC
 
+// Arrays of at least STDR_MMAP_THRESHOLD bytes get their own mapping and
+// grow with mremap, which moves pages instead of copying them. Only with the
+// default allocator and where mremap is declared (Linux with _GNU_SOURCE).
+#ifndef STDR_MMAP_THRESHOLD
+#define STDR_MMAP_THRESHOLD ((usize)4 << 20)
+#endif
+
 typedef int8_t i8;
 typedef int16_t i16;
 typedef int32_t i32;
@@ -79,15 +94,112 @@ i64 str_parse_i64(str_t s);
 void str_to_lowercase(str_t s);
 void str_to_uppercase(str_t s);
 
-#ifndef STDR_HASH
-usize stdr_hash(str_t k);
-#define STDR_HASH stdr_hash
+// wyhash: 48 bytes per round on long keys, two overlapping reads for keys up
+// to 16 bytes. Maps hash with STDR_HASH_SEEDED(k, seed), which may be defined
+// to replace it. A one argument STDR_HASH(k) from before seeds were added
+// still works, its result is mixed with the map's seed.
+usize stdr_hash(str_t k, u64 seed);
+u64 stdr_hash_seed(void);
+#if defined(STDR_HASH_SEEDED)
+#elif defined(STDR_HASH)
+#define STDR_HASH_SEEDED(k, seed) \
+  ((usize)stdr_hash_u64((u64)STDR_HASH(k), seed))
+#else
+#define STDR_HASH_SEEDED stdr_hash
+#define STDR_HASH(k) stdr_hash(k, 0)
+#endif
+
+// 64x64 -> 128 bit multiply, both halves returned in place
+static inline void stdr_wymum(u64* a, u64* b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (u64)r;
+  *b = (u64)(r >> 64);
+#else
+  u64 ha = *a >> 32, hb = *b >> 32, la = (u32)*a, lb = (u32)*b;
+  u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  u64 t = rl + (rm0 << 32), c = t < rl;
+  u64 lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline u64 stdr_wymix(u64 a, u64 b) {
+  stdr_wymum(&a, &b);
+  return a ^ b;
+}
+
+// Folded multiply for integer keys
+static inline u64 stdr_hash_u64(u64 x, u64 seed) {
+  return stdr_wymix(x ^ seed, 0x9e3779b97f4a7c15ull);
+}
+
+// Allocator handle carried by arrays and maps, NULL selects STDR_MALLOC,
+// STDR_REALLOC and STDR_FREE. Sizes are passed back on realloc and free, so
+// an allocator needs no per block bookkeeping.
+typedef struct {
+  void* (*alloc)(void* ctx, usize size);
+  void* (*realloc)(void* ctx, void* ptr, usize old_size, usize new_size);
+  void (*free)(void* ctx, void* ptr, usize size);
+  void* ctx;
+} stdr_allocator_t;
+
+// Arrays and maps created on this thread after the call use a. Returns the
+// previous allocator, NULL is the default.
+stdr_allocator_t* stdr_allocator_set(stdr_allocator_t* a);
+stdr_allocator_t* stdr_allocator_get(void);
+
+void* stdr_alloc(stdr_allocator_t* a, usize size);
+void* stdr_realloc(stdr_allocator_t* a, void* ptr, usize old_size,
+                   usize new_size);
+void stdr_free(stdr_allocator_t* a, void* ptr, usize size);
+
+// Bump allocator. Memory comes from chunks that double in size and is only
+// given back by stdr_arena_reset and stdr_arena_free, except for the latest
+// block which can be grown or freed in place. Not thread safe.
+//
+//   stdr_arena_t arena;
+//   stdr_arena_init(&arena, 0, NULL);
+//   stdr_allocator_t* prev = stdr_allocator_set(&arena.allocator);
+//   ... arrays and maps ...
+//   stdr_allocator_set(prev);
+//   stdr_arena_reset(&arena);
+typedef struct stdr_arena_chunk stdr_arena_chunk_t;
+typedef struct {
+  // Handle for containers, valid while the arena does not move
+  stdr_allocator_t allocator;
+  // Where the chunks come from
+  stdr_allocator_t* parent;
+  stdr_arena_chunk_t* chunks;
+  char* top;
+  usize left;
+  usize chunk_size;
+  char* last;
+} stdr_arena_t;
+
+#ifndef STDR_ARENA_CHUNK
+#define STDR_ARENA_CHUNK ((usize)64 << 10)
 #endif
+#define STDR_ARENA_MAX_CHUNK ((usize)64 << 20)
+
+// chunk_size 0 selects STDR_ARENA_CHUNK
+void stdr_arena_init(stdr_arena_t* a, usize chunk_size,
+                     stdr_allocator_t* parent);
+// Blocks are aligned to align, a power of two
+void* stdr_arena_push(stdr_arena_t* a, usize size, usize align);
+#define stdr_arena_alloc(a, size) stdr_arena_push(a, size, 16)
+// Frees all blocks. Chunks are merged into one, so a reused arena settles
+// on a single chunk.
+void stdr_arena_reset(stdr_arena_t* a);
+void stdr_arena_free(stdr_arena_t* a);
 
 typedef struct {
   usize item_size;
   usize count;
   usize capacity;
+  stdr_allocator_t* allocator;
 } arr_header_t;
 
 #define arr(T) T*
@@ -114,9 +226,99 @@ usize capacity_grow(usize capacity);
     (a)[arr_header(a)->count++] = (__VA_ARGS__);                       \
   } while (0)
 
+// Capacity for at least n items. Grows geometrically, so reserving one more
+// item at a time stays amortised O(1).
+arr(void) arr_grow(arr(void) a, usize item_size, usize n);
+void arr_append_n_cpy(arr(void) * a, usize item_size, const void* items,
+                      usize n);
+void arr_resize_cpy(arr(void) * a, usize item_size, usize n);
+
+#define arr_reserve(a, n) ((a) = arr_grow(a, sizeof(*(a)), n))
+// Appends items[0 .. n) with one copy
+#define arr_append_n(a, items, n) \
+  arr_append_n_cpy((void**)&(a), sizeof(*(a)), items, n)
+// Sets the count to n, new items are zeroed
+#define arr_resize(a, n) arr_resize_cpy((void**)&(a), sizeof(*(a)), n)
+
 #define arr_sort(a, cmp) \
   qsort(a, (size_t)arr_count(a), (size_t)arr_item_size(a), cmp)
 
+// Top k selection with a bounded heap, O(n log k) instead of sorting all n.
+// arr_top_k_push keeps the k items that sort first under cmp in *top, as a
+// heap with the one that sorts last at [0]. arr_top_k_sort then orders them
+// like arr_sort would.
+void arr_top_k_push(arr(void) * top, usize item_size, usize k,
+                    const void* item, int (*cmp)(const void*, const void*));
+void arr_top_k_sort(arr(void) top, usize item_size,
+                    int (*cmp)(const void*, const void*));
+arr(void) arr_top_k_cpy(const void* a, usize n, usize item_size, usize k,
+                        int (*cmp)(const void*, const void*));
+
+// New array with the first k items of a sorted by cmp, a is not changed
+#define arr_top_k(a, k, cmp) \
+  ((typeof(a))arr_top_k_cpy(a, arr_count(a), sizeof(*(a)), k, cmp))
+
+// Struct of arrays, one column per field with a shared count and capacity,
+// so a scan over one field only reads that field. Fields are an X macro:
+//
+//   #define TOKEN_FIELDS(X) X(str_t, word) X(u64, hash) X(i64, freq)
+//   STDR_SOA_DEFINE(tokens, TOKEN_FIELDS)
+//   tokens_t t = {0};
+//   tokens_append(&t, str("the"), h, 1);
+//   for (usize i = 0; i < t.count; i++) total += t.freq[i] ...
+//   tokens_free(&t);
+//
+// defines name_t and name_reserve, name_push (a zeroed row, returns its
+// index), name_append, name_clear and name_free. Fields cannot be named
+// count, capacity, allocator or s. Columns come from the allocator that was
+// current at the first growth.
+#define STDR_SOA_COLUMN(T, f) T* f;
+#define STDR_SOA_PARAM(T, f) , T f
+#define STDR_SOA_SET(T, f) s->f[i] = f;
+#define STDR_SOA_ZERO(T, f) memset(&s->f[i], 0, sizeof(T));
+#define STDR_SOA_GROW(T, f)                                        \
+  s->f = stdr_realloc(s->allocator, s->f, s->capacity * sizeof(T), \
+                      capacity * sizeof(T));
+#define STDR_SOA_FREE(T, f) \
+  stdr_free(s->allocator, s->f, s->capacity * sizeof(T));
+
+#define STDR_SOA_DEFINE(name, fields)                                    \
+  typedef struct {                                                       \
+    usize count;                                                         \
+    usize capacity;                                                      \
+    stdr_allocator_t* allocator;                                         \
+    fields(STDR_SOA_COLUMN)                                              \
+  } name##_t;                                                            \
+                                                                         \
+  static inline void name##_reserve(name##_t* s, usize n) {              \
+    if (n <= s->capacity) return;                                        \
+    if (s->capacity == 0) s->allocator = stdr_allocator_get();           \
+    usize capacity = capacity_grow(s->capacity);                         \
+    if (capacity < n) capacity = n;                                      \
+    fields(STDR_SOA_GROW)                                                \
+    s->capacity = capacity;                                              \
+  }                                                                      \
+                                                                         \
+  static inline usize name##_push(name##_t* s) {                         \
+    name##_reserve(s, s->count + 1);                                     \
+    usize i = s->count++;                                                \
+    fields(STDR_SOA_ZERO)                                                \
+    return i;                                                            \
+  }                                                                      \
+                                                                         \
+  static inline void name##_append(name##_t* s fields(STDR_SOA_PARAM)) { \
+    name##_reserve(s, s->count + 1);                                     \
+    usize i = s->count++;                                                \
+    fields(STDR_SOA_SET)                                                 \
+  }                                                                      \
+                                                                         \
+  static inline void name##_clear(name##_t* s) { s->count = 0; }         \
+                                                                         \
+  static inline void name##_free(name##_t* s) {                          \
+    fields(STDR_SOA_FREE)                                                \
+    *s = (name##_t){0};                                                  \
+  }
+
 arr(str_t) str_split_words(str_t s);
 arr(str_t) str_split_lines(str_t s);
 
@@ -126,12 +328,63 @@ typedef arr(char) dstr_t;
 
 void dstr_append(dstr_t* ds, char ch);
 void dstr_append_str(dstr_t* ds, str_t s);
+// printf into the end of ds. A NUL follows the new text but is not counted.
+void dstr_appendf(dstr_t* ds, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Keys up to MAP_KEY_INLINE bytes are stored in the entry itself, longer
+// ones by pointer. Entries are 32 bytes, two per cache line.
+#define MAP_KEY_INLINE 16
+
+typedef struct {
+  usize hash;
+  usize len;
+  union {
+    char* ptr;
+    char buf[MAP_KEY_INLINE];
+  } key;
+} map_entry_t;
+
+static inline str_t map_entry_key(map_entry_t* e) {
+  return (str_t){e->len <= MAP_KEY_INLINE ? e->key.buf : e->key.ptr, e->len};
+}
+
+// Map flags, passed to map_init.
+enum {
+  // Growing allocates the larger table but leaves the old one in place.
+  // Every later insert or lookup moves MAP_MIGRATE_STEP slots across, so no
+  // single operation pays for rehashing the whole map.
+  MAP_INCREMENTAL = 1 << 0,
+  // Slots hold a u32 index into dense, insertion ordered entry and value
+  // arrays, like CPython's dict. m[0 .. map_end(m)] are the values in
+  // insertion order, removed keys leave holes until the next rehash.
+  // Cannot be combined with MAP_INCREMENTAL.
+  MAP_COMPACT = 1 << 1,
+  // New keys are copied into a bump arena owned by the map and freed with
+  // it, so the caller's buffers can be released right after inserting.
+  MAP_OWN_KEYS = 1 << 2,
+};
 
 typedef struct {
   usize count;
   usize capacity;
   usize item_size;
-  str_t* entries;
+  u32 flags;
+  // Random per map, so colliding keys cannot be precomputed
+  u64 seed;
+  // Tombstones. They keep probe chains intact and count towards the load
+  usize deleted;
+  u8* ctrl;
+  map_entry_t* entries;
+  // MAP_COMPACT only: slot to entry index and number of used entries
+  u32* index;
+  usize used;
+  stdr_allocator_t* allocator;
+  // MAP_OWN_KEYS only: copies of the keys
+  stdr_arena_t keys;
+  // Table being drained while MAP_INCREMENTAL growth is in progress
+  void* old;
+  usize migrated;
 } map_header_t;
 
 #define map(T) T*
@@ -142,33 +395,166 @@ typedef struct {
 #define map_item_size(m) (map_header(m)->item_size)
 #define map_size(m) (map_capacity(m) * map_item_size(m))
 #define map_entries(m) (map_header(m)->entries)
+#define map_ctrl(m) (map_header(m)->ctrl)
+
+// Every slot has a control byte. Full slots store the low 7 bits of the key
+// hash, so a group of 16 slots is filtered with one compare before any key
+// is touched.
+#define MAP_GROUP_WIDTH 16
+#define MAP_CTRL_EMPTY ((u8)0x80)
+#define MAP_CTRL_DELETED ((u8)0xFE)
+#define MAP_MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+#define map_slot_full(m, i) (map_ctrl(m)[i] < MAP_CTRL_EMPTY)
+
+// Removed entries of compact maps
+#define MAP_HOLE ((usize)-1)
+
+// Iterates the values of either layout:
+//   for (usize i = 0; i < map_end(m); i++) if (map_live(m, i)) m[i] ...
+#define map_compact(m) (map_header(m)->flags & MAP_COMPACT)
+#define map_end(m) (map_compact(m) ? map_header(m)->used : map_capacity(m))
+#define map_live(m, i) \
+  (map_compact(m) ? map_entries(m)[i].len != MAP_HOLE : map_slot_full(m, i))
+// Short keys point into the entry, valid until the map is changed
+#define map_key(m, i) map_entry_key(&map_entries(m)[i])
+
+static inline u32 map_group_match(const u8* ctrl, u8 h2) {
+#ifdef __SSE2__
+  __m128i g = _mm_loadu_si128((const __m128i*)ctrl);
+  return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)h2)));
+#else
+  u32 mask = 0;
+  for (u32 i = 0; i < MAP_GROUP_WIDTH; i++) mask |= (u32)(ctrl[i] == h2) << i;
+  return mask;
+#endif
+}
+
+static inline u32 map_group_match_empty(const u8* ctrl) {
+  return map_group_match(ctrl, MAP_CTRL_EMPTY);
+}
+
+// Empty or deleted slots, both have the high bit set
+static inline u32 map_group_match_free(const u8* ctrl) {
+#ifdef __SSE2__
+  return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+  u32 mask = 0;
+  for (u32 i = 0; i < MAP_GROUP_WIDTH; i++) mask |= (u32)(ctrl[i] >> 7) << i;
+  return mask;
+#endif
+}
 
-map(void) map_alloc(usize item_size, usize capacity);
+#ifndef MAP_MIGRATE_STEP
+#define MAP_MIGRATE_STEP (2 * MAP_GROUP_WIDTH)
+#endif
+
+// First chunk of the MAP_OWN_KEYS arena
+#define MAP_KEY_CHUNK ((usize)4096)
+
+map(void) map_alloc(usize item_size, usize capacity, u32 flags);
 map(void) map_realloc(map(void) m, usize new_capacity);
 void map_free(map(void) m);
+void map_migrate_all(map(void) m);
+map(void) map_fit(map(void) m);
+
+// Rehashes into the smallest table that holds the current entries
+#define map_shrink(m) ((m) = map_fit(m))
+
+// Smallest capacity that holds count entries without growing
+usize map_capacity_for(usize count);
+
+// Sizes the map for n entries, so the next inserts up to n never rehash
+#define map_reserve(m, n)                                              \
+  ((m) = (m) == NULL ? map_alloc(sizeof(*(m)), map_capacity_for(n), 0) \
+         : map_capacity(m) >= map_capacity_for(n)                      \
+             ? (m)                                                     \
+             : map_realloc(m, map_capacity_for(n)))
+
+#define map_init(m, capacity, flags) \
+  ((m) = map_alloc(sizeof(*(m)), capacity, flags))
 
 usize map_get_idx(map(void) m, str_t k);
 void* map_get_ptr(map(void) m, str_t k);
 
+// Variants for callers that already hashed the key with map_hash
+#define map_hash(m, k) STDR_HASH_SEEDED(k, map_header(m)->seed)
+usize map_lookup(map(void) m, str_t k, usize hash);
+usize map_upsert(map(void) * m, str_t k, usize hash, bool* inserted);
+
+// Looks up keys[0..n) into out, NULL for missing keys. Keys are hashed and
+// prefetched MAP_BATCH at a time so their cache misses overlap.
+void map_get_batch_ptr(map(void) m, const str_t* keys, usize n, void** out);
+#define map_get_batch(m, keys, n, out) \
+  map_get_batch_ptr(m, keys, n, (void**)(out))
+
 #define map_has(m, k) (m == NULL ? false : (map_get_idx(m, k) != (usize) - 1))
 #define map_get(m, k) ((typeof(m))map_get_ptr(m, k))
 
+bool map_remove(map(void) m, str_t k);
+
+usize map_insert_key(map(void) * m, str_t k);
 void map_insert_cpy(map(void) * m, str_t k, void* data);
-#define map_insert(m, k, ...)                             \
-  do {                                                    \
-    if ((m) == NULL) (m) = map_alloc(sizeof(*(m)), 32);   \
-    usize map_insert_i = map_insert_key((void**)&(m), k); \
-    (m)[map_insert_i] = (__VA_ARGS__);                    \
+#define map_insert(m, k, ...)                              \
+  do {                                                     \
+    if ((m) == NULL) (m) = map_alloc(sizeof(*(m)), 32, 0); \
+    usize map_insert_i = map_insert_key((void**)&(m), k);  \
+    (m)[map_insert_i] = (__VA_ARGS__);                     \
   } while (0)
 
-#define map_items_collect(m, dst)                                            \
-  for (usize map_items_collect_i = 0; map_items_collect_i < map_capacity(m); \
-       map_items_collect_i++) {                                              \
-    if (map_entries(m)[map_items_collect_i].ptr == NULL) continue;           \
-    typeof(*acc) pair = {map_entries(m)[map_items_collect_i],                \
-                         *map_get(m, map_entries(m)[map_items_collect_i])};  \
-    arr_append(dst, pair);                                                   \
-  }
+// Hashes k once and returns its value slot. A missing key is inserted with a
+// zeroed value.
+void* map_get_or_insert_ptr(map(void) * m, str_t k);
+#define map_get_or_insert(m, k)                                          \
+  ((m) == NULL ? (void)((m) = map_alloc(sizeof(*(m)), 32, 0)) : (void)0, \
+   (typeof(m))map_get_or_insert_ptr((void**)&(m), k))
+#define map_increment(m, k, n) (*map_get_or_insert(m, k) += (n))
+
+// Inserts keys[i] -> values[i]. An empty map is sized for all n keys up
+// front, a map with entries grows as needed since keys may already exist.
+// Keys are hashed and their groups prefetched MAP_BATCH at a time before any
+// of them is probed.
+#define MAP_BATCH 16
+void map_insert_arrays_cpy(map(void) * m, const str_t* keys,
+                           const void* values, usize n);
+map(void) map_from_arrays_cpy(const str_t* keys, const void* values,
+                              usize item_size, usize n);
+#define map_insert_arrays(m, keys, values, n)                   \
+  do {                                                          \
+    map_reserve(m, (m) == NULL || map_count(m) == 0 ? (n) : 0); \
+    map_insert_arrays_cpy((void**)&(m), keys, values, n);       \
+  } while (0)
+#define map_from_arrays(keys, values, n)                                    \
+  ((typeof(*(values))*)map_from_arrays_cpy(keys, values, sizeof(*(values)), \
+                                           n))
+
+// Appends a {key, value} pair per entry. Keys of up to MAP_KEY_INLINE bytes
+// point into the map itself, so the pairs are only valid until the map is
+// freed or changed: any insert may rehash or move entries.
+#define map_items_collect(m, dst)                                         \
+  do {                                                                    \
+    map_migrate_all(m);                                                   \
+    for (usize map_items_collect_i = 0; map_items_collect_i < map_end(m); \
+         map_items_collect_i++) {                                         \
+      if (!map_live(m, map_items_collect_i)) continue;                    \
+      typeof(*(dst)) pair = {map_key(m, map_items_collect_i),             \
+                             (m)[map_items_collect_i]};                   \
+      arr_append(dst, pair);                                              \
+    }                                                                     \
+  } while (0)
+
+// Like map_items_collect followed by arr_sort, but only the k first pairs
+// are ever stored in dst. Same lifetime for the keys of the pairs.
+#define map_top_k(m, dst, k, cmp)                                          \
+  do {                                                                     \
+    map_migrate_all(m);                                                    \
+    for (usize map_top_k_i = 0; map_top_k_i < map_end(m); map_top_k_i++) { \
+      if (!map_live(m, map_top_k_i)) continue;                             \
+      typeof(*(dst)) pair = {map_key(m, map_top_k_i), (m)[map_top_k_i]};   \
+      arr_top_k_push((void**)&(dst), sizeof(*(dst)), k, &pair, cmp);       \
+    }                                                                      \
+    arr_top_k_sort(dst, sizeof(*(dst)), cmp);                              \
+  } while (0)
 
 dstr_t read_file(cstr_t filename);
 
@@ -200,20 +586,92 @@ void cmd_run_reset(cmd_t* cmd);
 #include <stdarg.h>
 #include <stdio.h>
 #include <strings.h>
-#include <sys/wait.h>  // waitpid
-#include <unistd.h>    // fork
+#include <sys/mman.h>    // mmap, mremap
+#include <sys/random.h>  // getentropy
+#include <sys/wait.h>    // waitpid
+#include <time.h>        // clock
+#include <unistd.h>      // fork
 
 #ifndef STDR_ASSERT
 #include <assert.h>
 #define STDR_ASSERT assert
 #endif
 
-usize stdr_hash(str_t k) {
-  usize hash = 0;
-  for (usize i = 0; i < (usize)k.len; ++i) {
-    hash = ((u8*)(k.ptr))[i] + (hash << 6) + (hash << 16) - hash;
+#if defined(STDR_DEFAULT_ALLOCATOR) && defined(MREMAP_MAYMOVE)
+#define STDR_ARR_MMAP 1
+#endif
+
+static const u64 stdr_wyp[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+static inline u64 stdr_wyr8(const u8* p) {
+  u64 v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline u64 stdr_wyr4(const u8* p) {
+  u32 v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline u64 stdr_wyr3(const u8* p, usize n) {
+  return ((u64)p[0] << 16) | ((u64)p[n >> 1] << 8) | p[n - 1];
+}
+
+usize stdr_hash(str_t k, u64 seed) {
+  const u8* p = (const u8*)k.ptr;
+  usize n = k.len;
+  u64 a, b;
+  seed ^= stdr_wymix(seed ^ stdr_wyp[0], stdr_wyp[1]);
+  if (n <= 16) {
+    if (n >= 4) {
+      usize o = (n >> 3) << 2;
+      a = (stdr_wyr4(p) << 32) | stdr_wyr4(p + o);
+      b = (stdr_wyr4(p + n - 4) << 32) | stdr_wyr4(p + n - 4 - o);
+    } else if (n > 0) {
+      a = stdr_wyr3(p, n);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    usize i = n;
+    if (i > 48) {
+      u64 see1 = seed, see2 = seed;
+      do {
+        seed = stdr_wymix(stdr_wyr8(p) ^ stdr_wyp[1], stdr_wyr8(p + 8) ^ seed);
+        see1 = stdr_wymix(stdr_wyr8(p + 16) ^ stdr_wyp[2],
+                          stdr_wyr8(p + 24) ^ see1);
+        see2 = stdr_wymix(stdr_wyr8(p + 32) ^ stdr_wyp[3],
+                          stdr_wyr8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = stdr_wymix(stdr_wyr8(p) ^ stdr_wyp[1], stdr_wyr8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = stdr_wyr8(p + i - 16);
+    b = stdr_wyr8(p + i - 8);
+  }
+  a ^= stdr_wyp[1];
+  b ^= seed;
+  stdr_wymum(&a, &b);
+  return (usize)stdr_wymix(a ^ stdr_wyp[0] ^ n, b ^ stdr_wyp[1]);
+}
+
+u64 stdr_hash_seed(void) {
+  static _Thread_local u64 state = 0;
+  if (state == 0 && getentropy(&state, sizeof(state)) != 0) {
+    state = (u64)(uintptr_t)&state ^ (u64)clock();
   }
-  return hash;
+  state += stdr_wyp[0];
+  return stdr_wymix(state, state ^ stdr_wyp[1]);
 }
 
 usize capacity_grow(usize capacity) {
@@ -227,11 +685,14 @@ bool is_new_line(char ch) { return ch == '\n'; }
 bool not_is_new_line(char ch) { return !is_new_line(ch); }
 
 str_t str_alloc(usize len) {
-  str_t s = {.ptr = malloc((size_t)len), .len = len + 1};
+  // Zeroed with a NUL past the end, so the result is also a C string
+  str_t s = {.ptr = malloc((size_t)len + 1), .len = len};
   memset(s.ptr, 0, (size_t)len + 1);
   return s;
 }
 
+void str_free(str_t s) { free(s.ptr); }
+
 void str_to_lowercase(str_t s) {
   for (usize i = 0; i < s.len; i++) {
     ((char*)s.ptr)[i] = (char)tolower(((char*)s.ptr)[i]);
@@ -332,56 +793,572 @@ arr(str_t) str_split_lines(str_t s) {
 }
 
 void dstr_append(dstr_t* ds, char ch) { arr_append(*ds, ch); }
-void dstr_append_str(dstr_t* ds, str_t s) {
-  for (usize i = 0; i < s.len; i++) {
-    dstr_append(ds, s.ptr[i]);
+void dstr_append_str(dstr_t* ds, str_t s) { arr_append_n(*ds, s.ptr, s.len); }
+
+void dstr_appendf(dstr_t* ds, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  va_list copy;
+  va_copy(copy, args);
+  int len = vsnprintf(NULL, 0, fmt, copy);
+  va_end(copy);
+  STDR_ASSERT(len >= 0);
+
+  usize count = arr_count(*ds);
+  arr_reserve(*ds, count + (usize)len + 1);
+  vsnprintf(&(*ds)[count], (size_t)len + 1, fmt, args);
+  va_end(args);
+  arr_header(*ds)->count = count + (usize)len;
+}
+
+static _Thread_local stdr_allocator_t* stdr_allocator_current = NULL;
+
+stdr_allocator_t* stdr_allocator_set(stdr_allocator_t* a) {
+  stdr_allocator_t* prev = stdr_allocator_current;
+  stdr_allocator_current = a;
+  return prev;
+}
+
+stdr_allocator_t* stdr_allocator_get(void) { return stdr_allocator_current; }
+
+void* stdr_alloc(stdr_allocator_t* a, usize size) {
+  if (a == NULL) return STDR_MALLOC((size_t)size);
+  return a->alloc(a->ctx, size);
+}
+
+void* stdr_realloc(stdr_allocator_t* a, void* ptr, usize old_size,
+                   usize new_size) {
+  if (a != NULL) return a->realloc(a->ctx, ptr, old_size, new_size);
+#ifdef STDR_REALLOC
+  (void)old_size;
+  return STDR_REALLOC(ptr, (size_t)new_size);
+#else
+  void* p = STDR_MALLOC((size_t)new_size);
+  if (ptr != NULL) {
+    memcpy(p, ptr, (size_t)(old_size < new_size ? old_size : new_size));
+  }
+  STDR_FREE(ptr);
+  return p;
+#endif
+}
+
+void stdr_free(stdr_allocator_t* a, void* ptr, usize size) {
+  if (a == NULL) {
+    STDR_FREE(ptr);
+  } else if (ptr != NULL) {
+    a->free(a->ctx, ptr, size);
   }
 }
 
-void arr_free(arr(void) a) { STDR_FREE(arr_header(a)); }
+struct stdr_arena_chunk {
+  stdr_arena_chunk_t* next;
+  usize size;
+  _Alignas(16) char data[];
+};
+
+static void* stdr_arena_alloc_fn(void* ctx, usize size) {
+  return stdr_arena_alloc((stdr_arena_t*)ctx, size);
+}
+
+// The latest block grows in place while its chunk has room
+static void* stdr_arena_realloc_fn(void* ctx, void* ptr, usize old_size,
+                                   usize new_size) {
+  stdr_arena_t* a = ctx;
+  if (ptr != NULL && ptr == a->last &&
+      new_size <= (usize)(a->top - a->last) + a->left) {
+    usize top = (usize)(a->top - a->last);
+    a->left = a->left + top - new_size;
+    a->top = a->last + new_size;
+    return ptr;
+  }
+  void* p = stdr_arena_alloc(a, new_size);
+  if (ptr != NULL) {
+    memcpy(p, ptr, (size_t)(old_size < new_size ? old_size : new_size));
+  }
+  return p;
+}
+
+static void stdr_arena_free_fn(void* ctx, void* ptr, usize size) {
+  stdr_arena_t* a = ctx;
+  (void)size;
+  if (ptr != a->last) return;
+  a->left += (usize)(a->top - a->last);
+  a->top = a->last;
+  a->last = NULL;
+}
+
+void stdr_arena_init(stdr_arena_t* a, usize chunk_size,
+                     stdr_allocator_t* parent) {
+  *a = (stdr_arena_t){0};
+  a->allocator = (stdr_allocator_t){stdr_arena_alloc_fn, stdr_arena_realloc_fn,
+                                    stdr_arena_free_fn, a};
+  a->parent = parent;
+  a->chunk_size = chunk_size == 0 ? STDR_ARENA_CHUNK : chunk_size;
+}
+
+static void stdr_arena_chunk_new(stdr_arena_t* a, usize size) {
+  if (size < a->chunk_size) size = a->chunk_size;
+  stdr_arena_chunk_t* c =
+      stdr_alloc(a->parent, sizeof(stdr_arena_chunk_t) + size);
+  c->next = a->chunks;
+  c->size = size;
+  a->chunks = c;
+  a->top = c->data;
+  a->left = size;
+  if (a->chunk_size < STDR_ARENA_MAX_CHUNK) a->chunk_size *= 2;
+}
+
+void* stdr_arena_push(stdr_arena_t* a, usize size, usize align) {
+  usize pad = (usize)-(uintptr_t)a->top & (align - 1);
+  if (a->chunks == NULL || pad + size > a->left) {
+    stdr_arena_chunk_new(a, size + align);
+    pad = (usize)-(uintptr_t)a->top & (align - 1);
+  }
+  a->last = a->top + pad;
+  a->top = a->last + size;
+  a->left -= pad + size;
+  return a->last;
+}
+
+void stdr_arena_reset(stdr_arena_t* a) {
+  if (a->chunks == NULL) return;
+  if (a->chunks->next != NULL) {
+    usize size = 0;
+    for (stdr_arena_chunk_t* c = a->chunks; c != NULL; c = c->next) {
+      size += c->size;
+    }
+    stdr_arena_free(a);
+    stdr_arena_chunk_new(a, size);
+  }
+  a->top = a->chunks->data;
+  a->left = a->chunks->size;
+  a->last = NULL;
+}
+
+void stdr_arena_free(stdr_arena_t* a) {
+  stdr_arena_chunk_t* c = a->chunks;
+  while (c != NULL) {
+    stdr_arena_chunk_t* next = c->next;
+    stdr_free(a->parent, c, sizeof(stdr_arena_chunk_t) + c->size);
+    c = next;
+  }
+  a->chunks = NULL;
+  a->top = NULL;
+  a->left = 0;
+  a->last = NULL;
+}
+
+static inline usize arr_bytes(usize item_size, usize capacity) {
+  return sizeof(arr_header_t) + item_size * capacity;
+}
+
+// Whether a block of this size is mapped, so the size alone tells free and
+// realloc which way it was allocated
+static inline bool arr_mapped(usize bytes) {
+#ifdef STDR_ARR_MMAP
+  return bytes >= STDR_MMAP_THRESHOLD;
+#else
+  (void)bytes;
+  return false;
+#endif
+}
+
+static arr_header_t* arr_block_alloc(stdr_allocator_t* a, usize bytes) {
+#ifdef STDR_ARR_MMAP
+  if (a == NULL && arr_mapped(bytes)) {
+    void* p = mmap(NULL, (size_t)bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    STDR_ASSERT(p != MAP_FAILED);
+    return p;
+  }
+#endif
+  return stdr_alloc(a, bytes);
+}
+
+void arr_free(arr(void) a) {
+  if (a == NULL) return;
+  arr_header_t* h = (arr_header_t*)a - 1;
+  usize bytes = arr_bytes(h->item_size, h->capacity);
+#ifdef STDR_ARR_MMAP
+  if (h->allocator == NULL && arr_mapped(bytes)) {
+    munmap(h, (size_t)bytes);
+    return;
+  }
+#endif
+  stdr_free(h->allocator, h, bytes);
+}
 
 arr(void) arr_alloc(usize item_size, usize capacity) {
-  arr_header_t* a =
-      STDR_MALLOC(sizeof(arr_header_t) + (size_t)item_size * (size_t)capacity);
+  stdr_allocator_t* allocator = stdr_allocator_get();
+  arr_header_t* a = arr_block_alloc(allocator, arr_bytes(item_size, capacity));
   a->item_size = item_size;
   a->count = 0;
   a->capacity = capacity;
+  a->allocator = allocator;
 
   return a + 1;
 }
 
 arr(void) arr_realloc(arr(void) a, usize new_capacity) {
-  arr(void) b = arr_alloc(arr_item_size(a), new_capacity);
-  arr_header(b)->count = arr_header(a)->count;
-  memcpy(b, a, (size_t)(arr_item_size(a) * arr_count(a)));
+  arr_header_t* old = (arr_header_t*)a - 1;
+  usize old_bytes = arr_bytes(old->item_size, old->capacity);
+  usize new_bytes = arr_bytes(old->item_size, new_capacity);
+  if (old->count > new_capacity) old->count = new_capacity;
+
+  arr_header_t* h;
+  if (old->allocator != NULL) {
+    h = stdr_realloc(old->allocator, old, old_bytes, new_bytes);
+    h->capacity = new_capacity;
+    return h + 1;
+  }
+#ifdef STDR_ARR_MMAP
+  if (arr_mapped(old_bytes) && arr_mapped(new_bytes)) {
+    h = mremap(old, (size_t)old_bytes, (size_t)new_bytes, MREMAP_MAYMOVE);
+    STDR_ASSERT(h != MAP_FAILED);
+    h->capacity = new_capacity;
+    return h + 1;
+  }
+#endif
+#ifdef STDR_REALLOC
+  if (!arr_mapped(old_bytes) && !arr_mapped(new_bytes)) {
+    h = STDR_REALLOC(old, (size_t)new_bytes);
+    h->capacity = new_capacity;
+    return h + 1;
+  }
+#endif
+  // Crossing the mmap threshold, or no realloc
+  h = arr_block_alloc(NULL, new_bytes);
+  memcpy(h, old, (size_t)arr_bytes(old->item_size, old->count));
+  h->capacity = new_capacity;
   arr_free(a);
-  return b;
+  return h + 1;
+}
+
+arr(void) arr_grow(arr(void) a, usize item_size, usize n) {
+  if (a == NULL) return arr_alloc(item_size, n);
+  if (arr_capacity(a) >= n) return a;
+  usize capacity = capacity_grow(arr_capacity(a));
+  return arr_realloc(a, capacity > n ? capacity : n);
+}
+
+void arr_append_n_cpy(arr(void) * a, usize item_size, const void* items,
+                      usize n) {
+  if (n == 0) return;
+  usize count = arr_count(*a);
+  *a = arr_grow(*a, item_size, count + n);
+  memcpy(&((u8*)*a)[count * item_size], items, (size_t)(n * item_size));
+  arr_header(*a)->count = count + n;
+}
+
+void arr_resize_cpy(arr(void) * a, usize item_size, usize n) {
+  usize count = arr_count(*a);
+  *a = arr_grow(*a, item_size, n);
+  if (n > count) {
+    memset(&((u8*)*a)[count * item_size], 0, (size_t)((n - count) * item_size));
+  }
+  arr_header(*a)->count = n;
+}
+
+static void arr_item_swap(u8* a, u8* b, usize item_size) {
+  u8 tmp[64];
+  while (item_size > 0) {
+    usize n = item_size < sizeof(tmp) ? item_size : sizeof(tmp);
+    memcpy(tmp, a, (size_t)n);
+    memcpy(a, b, (size_t)n);
+    memcpy(b, tmp, (size_t)n);
+    a += n;
+    b += n;
+    item_size -= n;
+  }
+}
+
+// Max heap under cmp, the parent never sorts before its children
+static void arr_heap_sift(u8* heap, usize n, usize i, usize item_size,
+                          int (*cmp)(const void*, const void*)) {
+  for (;;) {
+    usize max = i;
+    usize l = 2 * i + 1;
+    usize r = l + 1;
+    if (l < n && cmp(&heap[l * item_size], &heap[max * item_size]) > 0) max = l;
+    if (r < n && cmp(&heap[r * item_size], &heap[max * item_size]) > 0) max = r;
+    if (max == i) return;
+    arr_item_swap(&heap[i * item_size], &heap[max * item_size], item_size);
+    i = max;
+  }
+}
+
+void arr_top_k_push(arr(void) * top, usize item_size, usize k,
+                    const void* item, int (*cmp)(const void*, const void*)) {
+  if (k == 0) return;
+  usize count = arr_count(*top);
+  if (count < k) {
+    arr_append_n_cpy(top, item_size, item, 1);
+    u8* heap = *top;
+    for (usize i = count; i > 0;) {
+      usize parent = (i - 1) / 2;
+      if (cmp(&heap[parent * item_size], &heap[i * item_size]) >= 0) break;
+      arr_item_swap(&heap[parent * item_size], &heap[i * item_size],
+                    item_size);
+      i = parent;
+    }
+    return;
+  }
+  // Full, item replaces the root if it sorts before it. Ties keep the
+  // earlier item.
+  u8* heap = *top;
+  if (cmp(item, heap) >= 0) return;
+  memcpy(heap, item, (size_t)item_size);
+  arr_heap_sift(heap, count, 0, item_size, cmp);
+}
+
+void arr_top_k_sort(arr(void) top, usize item_size,
+                    int (*cmp)(const void*, const void*)) {
+  u8* heap = top;
+  for (usize n = arr_count(top); n > 1; n--) {
+    arr_item_swap(heap, &heap[(n - 1) * item_size], item_size);
+    arr_heap_sift(heap, n - 1, 0, item_size, cmp);
+  }
 }
 
-map(void) map_alloc(usize item_size, usize capacity) {
-  map_header_t* map =
-      malloc(sizeof(map_header_t) + (size_t)capacity * (size_t)item_size);
+arr(void) arr_top_k_cpy(const void* a, usize n, usize item_size, usize k,
+                        int (*cmp)(const void*, const void*)) {
+  arr(void) top = arr_alloc(item_size, k < n ? k : n);
+  for (usize i = 0; i < n; i++) {
+    arr_top_k_push(&top, item_size, k, &((const u8*)a)[i * item_size], cmp);
+  }
+  arr_top_k_sort(top, item_size, cmp);
+  return top;
+}
+
+static usize map_capacity_round(usize capacity) {
+  usize c = MAP_GROUP_WIDTH;
+  while (c < capacity) c *= 2;
+  return c;
+}
+
+static inline usize map_entry_count(usize capacity, u32 flags) {
+  return flags & MAP_COMPACT ? MAP_MAX_LOAD(capacity) : capacity;
+}
+
+static map(void) map_alloc_with(stdr_allocator_t* a, usize item_size,
+                                usize capacity, u32 flags) {
+  STDR_ASSERT(!(flags & MAP_COMPACT) || !(flags & MAP_INCREMENTAL));
+  capacity = map_capacity_round(capacity);
+  STDR_ASSERT(!(flags & MAP_COMPACT) || capacity <= (usize)UINT32_MAX + 1);
+
+  usize entries = map_entry_count(capacity, flags);
+  map_header_t* map = stdr_alloc(a, sizeof(map_header_t) + entries * item_size);
   map->count = 0;
   map->capacity = capacity;
   map->item_size = item_size;
-  map->entries = malloc((size_t)capacity * sizeof(*map->entries));
-  memset(map->entries, 0, (size_t)capacity * sizeof(*map->entries));
+  map->flags = flags;
+  map->seed = stdr_hash_seed();
+  map->deleted = 0;
+  map->ctrl = stdr_alloc(a, capacity);
+  memset(map->ctrl, MAP_CTRL_EMPTY, (size_t)capacity);
+  map->entries = stdr_alloc(a, entries * sizeof(*map->entries));
+  map->index = NULL;
+  if (flags & MAP_COMPACT) {
+    map->index = stdr_alloc(a, capacity * sizeof(*map->index));
+  }
+  map->used = 0;
+  map->allocator = a;
+  stdr_arena_init(&map->keys, MAP_KEY_CHUNK, a);
+  map->old = NULL;
+  map->migrated = 0;
   return map + 1;
 }
 
-usize map_insert_key(map(void) * m, str_t k) {
-  usize i = STDR_HASH(k);
-  for (usize ii = 0; ii < 32; ii++) {
-    usize iii = (usize)(i + ii) % (usize)map_capacity(*m);
-    if (map_entries((*m))[iii].ptr != NULL) continue;
-    map_entries(*m)[iii] = k;
-    map_count(*m) += 1;
-    return (usize)iii;
+map(void) map_alloc(usize item_size, usize capacity, u32 flags) {
+  return map_alloc_with(stdr_allocator_get(), item_size, capacity, flags);
+}
+
+static inline usize map_slot_entry(map(void) m, usize slot) {
+  return map_header(m)->index == NULL ? slot : map_header(m)->index[slot];
+}
+
+// Triangular probing over groups visits every group once when the group
+// count is a power of two. Returns the slot of k.
+static usize map_find(map(void) m, str_t k, usize hash) {
+  usize groups = map_capacity(m) / MAP_GROUP_WIDTH;
+  usize g = (hash >> 7) & (groups - 1);
+  u8 h2 = (u8)(hash & 0x7F);
+  for (usize step = 1;; step++) {
+    const u8* ctrl = &map_ctrl(m)[g * MAP_GROUP_WIDTH];
+    u32 match = map_group_match(ctrl, h2);
+    while (match != 0) {
+      usize i = g * MAP_GROUP_WIDTH + (usize)__builtin_ctz(match);
+      match &= match - 1;
+      const map_entry_t* e = &map_entries(m)[map_slot_entry(m, i)];
+      if (e->hash != hash || e->len != k.len) continue;
+      const char* key = k.len <= MAP_KEY_INLINE ? e->key.buf : e->key.ptr;
+      if (memcmp(key, k.ptr, (size_t)k.len) == 0) return i;
+    }
+    if (map_group_match_empty(ctrl) != 0) return (usize)-1;
+    g = (g + step) & (groups - 1);
+  }
+}
+
+// Returns the first empty or deleted slot on the probe chain of hash and
+// marks it as full.
+static usize map_claim(map(void) m, usize hash) {
+  usize groups = map_capacity(m) / MAP_GROUP_WIDTH;
+  usize g = (hash >> 7) & (groups - 1);
+  for (usize step = 1;; step++) {
+    u32 avail = map_group_match_free(&map_ctrl(m)[g * MAP_GROUP_WIDTH]);
+    if (avail != 0) {
+      usize i = g * MAP_GROUP_WIDTH + (usize)__builtin_ctz(avail);
+      if (map_ctrl(m)[i] == MAP_CTRL_DELETED) map_header(m)->deleted -= 1;
+      map_ctrl(m)[i] = (u8)(hash & 0x7F);
+      return i;
+    }
+    g = (g + step) & (groups - 1);
+  }
+}
+
+// A group that still has an empty slot has never been full, so no probe
+// chain continues past it and the slot can be emptied right away. Only
+// slots in full groups need a tombstone.
+static void map_erase_slot(map(void) m, usize i) {
+  const u8* group = &map_ctrl(m)[i - i % MAP_GROUP_WIDTH];
+  if (map_group_match_empty(group) != 0) {
+    map_ctrl(m)[i] = MAP_CTRL_EMPTY;
+  } else {
+    map_ctrl(m)[i] = MAP_CTRL_DELETED;
+    map_header(m)->deleted += 1;
+  }
+}
+
+static str_t map_key_copy(map(void) m, str_t k) {
+  return str_cpy(k, stdr_arena_push(&map_header(m)->keys, k.len, 1));
+}
+
+// Hands the key arena to the table that replaces m
+static void map_key_arena_move(map(void) dst, map(void) src) {
+  map_header(dst)->keys = map_header(src)->keys;
+  map_header(dst)->keys.allocator.ctx = &map_header(dst)->keys;
+  stdr_arena_init(&map_header(src)->keys, MAP_KEY_CHUNK,
+                  map_header(src)->allocator);
+}
+
+// Returns the entry index, which is also the value index
+static usize map_place(map(void) m, const map_entry_t* e) {
+  usize i = map_claim(m, e->hash);
+  if (map_compact(m)) {
+    map_header(m)->index[i] = (u32)map_header(m)->used;
+    i = map_header(m)->used++;
   }
+  map_entries(m)[i] = *e;
+  map_count(m) += 1;
+  return i;
+}
 
-  *m = map_realloc(*m, capacity_grow(map_capacity(*m)));
-  usize iii = map_insert_key(m, k);
-  return iii;
+// Moves slot i of the draining table into m. The old slot becomes a
+// tombstone so probe chains through it stay intact.
+static usize map_migrate_slot(map(void) m, map(void) old, usize i) {
+  usize item_size = map_item_size(m);
+  map_entry_t e = map_entries(old)[i];
+  usize n = map_claim(m, e.hash);
+  map_entries(m)[n] = e;
+  memcpy(&((u8*)m)[n * item_size], &((u8*)old)[i * item_size],
+         (size_t)item_size);
+  map_ctrl(old)[i] = MAP_CTRL_DELETED;
+  return n;
+}
+
+static void map_migrate(map(void) m, usize slots) {
+  map_header_t* h = map_header(m);
+  if (h->old == NULL) return;
+
+  usize end = map_capacity(h->old) - h->migrated;
+  end = h->migrated + (slots < end ? slots : end);
+  for (usize i = h->migrated; i < end; i++) {
+    if (map_slot_full(h->old, i)) map_migrate_slot(m, h->old, i);
+  }
+  h->migrated = end;
+
+  if (h->migrated == map_capacity(h->old)) {
+    map_free(h->old);
+    h->old = NULL;
+  }
+}
+
+void map_migrate_all(map(void) m) {
+  if (m != NULL) map_migrate(m, (usize)-1);
+}
+
+// Finds k in m or in the table it is draining. Keys found in the old table
+// are pulled over first, so the returned slot always indexes m.
+static usize map_lookup_slot(map(void) m, str_t k, usize hash) {
+  usize i = map_find(m, k, hash);
+  map(void) old = map_header(m)->old;
+  if (old == NULL) return i;
+
+  if (i == (usize)-1) {
+    usize j = map_find(old, k, hash);
+    if (j != (usize)-1) i = map_migrate_slot(m, old, j);
+  }
+  map_migrate(m, MAP_MIGRATE_STEP);
+  return i;
+}
+
+usize map_lookup(map(void) m, str_t k, usize hash) {
+  usize i = map_lookup_slot(m, k, hash);
+  return i == (usize)-1 ? i : map_slot_entry(m, i);
+}
+
+// Called once live entries and tombstones reach the load limit. Mostly
+// deleted tables are rehashed at the same size to drop the tombstones.
+static map(void) map_grow(map(void) m) {
+  usize capacity = map_capacity(m);
+  if (map_count(m) >= MAP_MAX_LOAD(capacity) / 2) capacity *= 2;
+
+  if (!(map_header(m)->flags & MAP_INCREMENTAL)) {
+    return map_realloc(m, capacity);
+  }
+
+  map_migrate_all(m);
+  map(void) map_new = map_alloc_with(map_header(m)->allocator, map_item_size(m),
+                                     capacity, map_header(m)->flags);
+  map_header(map_new)->seed = map_header(m)->seed;
+  map_key_arena_move(map_new, m);
+  map_count(map_new) = map_count(m);
+  map_header(map_new)->old = m;
+  return map_new;
+}
+
+usize map_upsert(map(void) * m, str_t k, usize hash, bool* inserted) {
+  usize i = map_lookup(*m, k, hash);
+  *inserted = i == (usize)-1;
+  if (!*inserted) return i;
+
+  // Holes in the dense arrays of compact maps take room until a rehash
+  usize load = map_count(*m) + map_header(*m)->deleted;
+  if (map_compact(*m)) load = map_header(*m)->used;
+  if (load >= MAP_MAX_LOAD(map_capacity(*m))) *m = map_grow(*m);
+
+  map_entry_t e = {.hash = hash, .len = k.len};
+  if (k.len <= MAP_KEY_INLINE) {
+    memcpy(e.key.buf, k.ptr, (size_t)k.len);
+  } else if (map_header(*m)->flags & MAP_OWN_KEYS) {
+    e.key.ptr = map_key_copy(*m, k).ptr;
+  } else {
+    e.key.ptr = k.ptr;
+  }
+  return map_place(*m, &e);
+}
+
+usize map_insert_key(map(void) * m, str_t k) {
+  bool inserted;
+  return map_upsert(m, k, map_hash(*m, k), &inserted);
+}
+
+void* map_get_or_insert_ptr(map(void) * m, str_t k) {
+  bool inserted;
+  usize i = map_upsert(m, k, map_hash(*m, k), &inserted);
+  u8* value = &((u8*)*m)[i * map_item_size(*m)];
+  if (inserted) memset(value, 0, (size_t)map_item_size(*m));
+  return value;
 }
 
 void map_insert_cpy(map(void) * m, str_t k, void* data) {
@@ -394,33 +1371,122 @@ void map_insert_cpy(map(void) * m, str_t k, void* data) {
 }
 
 map(void) map_realloc(map(void) m, usize new_capacity) {
-  assert(new_capacity >= map_count(m));
-
-  map(void) map_new = map_alloc(map_item_size(m), new_capacity);
-  for (usize i = 0; i < map_capacity(m); i++) {
-    if (map_entries(m)[i].ptr == NULL) continue;
-    map_insert_cpy(&map_new, map_entries(m)[i],
-                   map_get_ptr(m, map_entries(m)[i]));
+  map_migrate_all(m);
+  STDR_ASSERT(MAP_MAX_LOAD(map_capacity_round(new_capacity)) > map_count(m));
+
+  usize item_size = map_item_size(m);
+  map(void) map_new = map_alloc_with(map_header(m)->allocator, item_size,
+                                     new_capacity, map_header(m)->flags);
+  map_header(map_new)->seed = map_header(m)->seed;
+  map_key_arena_move(map_new, m);
+  for (usize i = 0; i < map_end(m); i++) {
+    if (!map_live(m, i)) continue;
+    usize n = map_place(map_new, &map_entries(m)[i]);
+    memcpy(&((u8*)map_new)[n * item_size], &((u8*)m)[i * item_size],
+           (size_t)item_size);
   }
   map_free(m);
   return map_new;
 }
 
+usize map_capacity_for(usize count) {
+  usize capacity = MAP_GROUP_WIDTH;
+  while (MAP_MAX_LOAD(capacity) <= count) capacity *= 2;
+  return capacity;
+}
+
+map(void) map_fit(map(void) m) {
+  if (m == NULL) return NULL;
+
+  m = map_realloc(m, map_capacity_for(map_count(m)));
+
+  // Repack owned keys into one chunk, removed keys still take space in the
+  // old ones
+  if (map_header(m)->flags & MAP_OWN_KEYS) {
+    stdr_arena_t old = map_header(m)->keys;
+    usize bytes = 0;
+    for (usize i = 0; i < map_end(m); i++) {
+      usize len = map_entries(m)[i].len;
+      if (map_live(m, i) && len > MAP_KEY_INLINE) bytes += len;
+    }
+    stdr_arena_init(&map_header(m)->keys, bytes, map_header(m)->allocator);
+    for (usize i = 0; i < map_end(m); i++) {
+      map_entry_t* e = &map_entries(m)[i];
+      if (!map_live(m, i) || e->len <= MAP_KEY_INLINE) continue;
+      e->key.ptr = map_key_copy(m, map_entry_key(e)).ptr;
+    }
+    stdr_arena_free(&old);
+  }
+  return m;
+}
+
+static inline void map_prefetch(map(void) m, usize hash) {
+  usize groups = map_capacity(m) / MAP_GROUP_WIDTH;
+  usize i = ((hash >> 7) & (groups - 1)) * MAP_GROUP_WIDTH;
+  __builtin_prefetch(&map_ctrl(m)[i]);
+  if (map_compact(m)) {
+    __builtin_prefetch(&map_header(m)->index[i]);
+  } else {
+    __builtin_prefetch(&map_entries(m)[i]);
+  }
+}
+
+void map_insert_arrays_cpy(map(void) * m, const str_t* keys,
+                           const void* values, usize n) {
+  usize item_size = map_item_size(*m);
+  usize hashes[MAP_BATCH];
+  for (usize b = 0; b < n; b += MAP_BATCH) {
+    usize len = n - b < MAP_BATCH ? n - b : MAP_BATCH;
+    for (usize i = 0; i < len; i++) {
+      hashes[i] = map_hash(*m, keys[b + i]);
+      map_prefetch(*m, hashes[i]);
+    }
+    for (usize i = 0; i < len; i++) {
+      bool inserted;
+      usize j = map_upsert(m, keys[b + i], hashes[i], &inserted);
+      memcpy(&((u8*)*m)[j * item_size],
+             &((const u8*)values)[(b + i) * item_size], (size_t)item_size);
+    }
+  }
+}
+
+map(void) map_from_arrays_cpy(const str_t* keys, const void* values,
+                              usize item_size, usize n) {
+  map(void) m = map_alloc(item_size, map_capacity_for(n), 0);
+  map_insert_arrays_cpy(&m, keys, values, n);
+  return m;
+}
+
+bool map_remove(map(void) m, str_t k) {
+  if (m == NULL) return false;
+
+  usize i = map_lookup_slot(m, k, map_hash(m, k));
+  if (i == (usize)-1) return false;
+
+  if (map_compact(m)) map_entries(m)[map_slot_entry(m, i)].len = MAP_HOLE;
+  map_erase_slot(m, i);
+  map_count(m) -= 1;
+  return true;
+}
+
 void map_free(map(void) m) {
   if (m == NULL) return;
-  free(map_header(m)->entries);
-  free(map_header(m));
+  map_header_t* h = map_header(m);
+  map_free(h->old);
+  stdr_arena_free(&h->keys);
+
+  usize entries = map_entry_count(h->capacity, h->flags);
+  if (h->index != NULL) {
+    stdr_free(h->allocator, h->index, h->capacity * sizeof(*h->index));
+  }
+  stdr_free(h->allocator, h->entries, entries * sizeof(*h->entries));
+  stdr_free(h->allocator, h->ctrl, h->capacity);
+  stdr_free(h->allocator, h, sizeof(map_header_t) + entries * h->item_size);
 }
 
 usize map_get_idx(map(void) m, str_t k) {
-  usize i = STDR_HASH(k);
-  for (usize ii = 0; ii < 32; ii++) {
-    usize iii = (usize)((i + ii) % map_capacity(m));
-    if (map_entries(m)[iii].ptr == NULL) continue;
-    if (map_entries(m)[iii].len != k.len) continue;
-    if (memcmp(map_entries(m)[iii].ptr, k.ptr, (size_t)k.len) == 0) return iii;
-  }
-  return (usize)-1;
+  if (m == NULL) return (usize)-1;
+  return map_lookup(m, k, map_hash(m, k));
 }
 
 void* map_get_ptr(map(void) m, str_t k) {
@@ -429,13 +1495,45 @@ void* map_get_ptr(map(void) m, str_t k) {
   return &((u8*)m)[(usize)idx * map_item_size(m)];
 }
 
+void map_get_batch_ptr(map(void) m, const str_t* keys, usize n, void** out) {
+  if (m == NULL) {
+    for (usize i = 0; i < n; i++) out[i] = NULL;
+    return;
+  }
+
+  usize hashes[MAP_BATCH];
+  for (usize b = 0; b < n; b += MAP_BATCH) {
+    usize len = n - b < MAP_BATCH ? n - b : MAP_BATCH;
+    for (usize i = 0; i < len; i++) {
+      hashes[i] = map_hash(m, keys[b + i]);
+      map_prefetch(m, hashes[i]);
+    }
+    for (usize i = 0; i < len; i++) {
+      usize j = map_lookup(m, keys[b + i], hashes[i]);
+      out[b + i] = j == (usize)-1 ? NULL : &((u8*)m)[j * map_item_size(m)];
+    }
+  }
+}
+
 arr(char) read_file(cstr_t filename) {
   FILE* f = fopen(filename, "r");
 
+  // The size is only a hint, pipes and growing files are read to the end
   arr(char) content = NULL;
-  int ch;
-  while (ch = fgetc(f), ch != EOF) {
-    arr_append(content, (char)ch);
+  usize hint = 4096;
+  if (fseek(f, 0, SEEK_END) == 0) {
+    long size = ftell(f);
+    if (size > 0) hint = (usize)size + 1;
+    rewind(f);
+  }
+  arr_reserve(content, hint);
+  for (;;) {
+    usize count = arr_count(content);
+    if (count == arr_capacity(content)) arr_reserve(content, count + 1);
+    usize n = fread(&content[count], 1,
+                    (size_t)(arr_capacity(content) - count), f);
+    arr_header(content)->count = count + n;
+    if (n == 0) break;
   }
   arr_append(content, '\0');
   fclose(f);
@@ -0,0 +1,260 @@
+#ifndef STDR_BITSET_H_
+#define STDR_BITSET_H_
+
+#include "stdr.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>  // _mm256_and_si256, _mm256_shuffle_epi8
+#endif
+
+// Fixed size set of bits, 64 to a word instead of a byte per flag like
+// arr(bool). Bulk operations run a vector at a time with AVX2 or SSE2 when
+// the target has them.
+//
+//   bitset_t seen;
+//   bitset_init(&seen, doc_count);
+//   bitset_set(&seen, i);
+//   bitset_and(&both, &seen, &other);
+//   usize n = bitset_popcount(&both);
+//   bitset_free(&seen);
+//
+// rank and select use a directory of counts per 512 bits that is built by
+// bitset_build_rank and is only valid until the next change.
+
+typedef struct {
+  // Bits, the unused bits of the last word are always zero
+  usize count;
+  u64* words;
+  // Set bits before each 512 bit block, NULL until bitset_build_rank
+  usize* ranks;
+  stdr_allocator_t* allocator;
+} bitset_t;
+
+#define BITSET_RANK_WORDS 8
+
+#define bitset_word_count(count) (((count) + 63) / 64)
+
+// Zeroed, words come from the current allocator
+void bitset_init(bitset_t* b, usize count);
+void bitset_free(bitset_t* b);
+
+static inline void bitset_set(bitset_t* b, usize i) {
+  STDR_ASSERT(i < b->count);
+  b->words[i / 64] |= (u64)1 << (i % 64);
+}
+
+static inline void bitset_clear(bitset_t* b, usize i) {
+  STDR_ASSERT(i < b->count);
+  b->words[i / 64] &= ~((u64)1 << (i % 64));
+}
+
+static inline bool bitset_test(const bitset_t* b, usize i) {
+  STDR_ASSERT(i < b->count);
+  return (b->words[i / 64] >> (i % 64)) & 1;
+}
+
+void bitset_clear_all(bitset_t* b);
+
+// dst = a op b. All three have the same count, dst may be a or b.
+void bitset_and(bitset_t* dst, const bitset_t* a, const bitset_t* b);
+void bitset_or(bitset_t* dst, const bitset_t* a, const bitset_t* b);
+void bitset_xor(bitset_t* dst, const bitset_t* a, const bitset_t* b);
+// dst = a & ~b
+void bitset_andnot(bitset_t* dst, const bitset_t* a, const bitset_t* b);
+
+usize bitset_popcount(const bitset_t* b);
+
+void bitset_build_rank(bitset_t* b);
+// Set bits in [0, i)
+usize bitset_rank(const bitset_t* b, usize i);
+// Index of the set bit with rank k, (usize)-1 if there are k or fewer
+usize bitset_select(const bitset_t* b, usize k);
+
+#endif  // STDR_BITSET_H_
+
+#ifdef STDR_BITSET_IMPLEMENTATION
+
+void bitset_init(bitset_t* b, usize count) {
+  *b = (bitset_t){0};
+  b->count = count;
+  b->allocator = stdr_allocator_get();
+  usize bytes = bitset_word_count(count) * sizeof(u64);
+  b->words = stdr_alloc(b->allocator, bytes);
+  memset(b->words, 0, (size_t)bytes);
+}
+
+static inline usize bitset_rank_count(const bitset_t* b) {
+  usize n = bitset_word_count(b->count);
+  return (n + BITSET_RANK_WORDS - 1) / BITSET_RANK_WORDS + 1;
+}
+
+void bitset_free(bitset_t* b) {
+  stdr_free(b->allocator, b->words, bitset_word_count(b->count) * sizeof(u64));
+  if (b->ranks != NULL) {
+    stdr_free(b->allocator, b->ranks, bitset_rank_count(b) * sizeof(usize));
+  }
+  *b = (bitset_t){0};
+}
+
+void bitset_clear_all(bitset_t* b) {
+  memset(b->words, 0, (size_t)(bitset_word_count(b->count) * sizeof(u64)));
+}
+
+// Word loops with the vector version first and the scalar one for the rest.
+// The unaligned loads cost nothing extra on current cores.
+#ifdef __AVX2__
+#define bitset_andnot256(x, y) _mm256_andnot_si256(y, x)
+#define bitset_andnot128(x, y) _mm_andnot_si128(y, x)
+#define BITSET_VECTOR_OP(d, x, y, n, i, op256, op128)       \
+  for (; i + 4 <= n; i += 4) {                              \
+    __m256i va = _mm256_loadu_si256((const __m256i*)&x[i]); \
+    __m256i vb = _mm256_loadu_si256((const __m256i*)&y[i]); \
+    _mm256_storeu_si256((__m256i*)&d[i], op256(va, vb));    \
+  }
+#elif defined(__SSE2__)
+#define bitset_andnot128(x, y) _mm_andnot_si128(y, x)
+#define BITSET_VECTOR_OP(d, x, y, n, i, op256, op128)    \
+  for (; i + 2 <= n; i += 2) {                           \
+    __m128i va = _mm_loadu_si128((const __m128i*)&x[i]); \
+    __m128i vb = _mm_loadu_si128((const __m128i*)&y[i]); \
+    _mm_storeu_si128((__m128i*)&d[i], op128(va, vb));    \
+  }
+#else
+#define BITSET_VECTOR_OP(d, x, y, n, i, op256, op128)
+#endif
+
+#define BITSET_DEFINE_OP(name, op, op256, op128)                 \
+  void bitset_##name(bitset_t* dst, const bitset_t* a,           \
+                     const bitset_t* b) {                        \
+    STDR_ASSERT(dst->count == a->count && a->count == b->count); \
+    u64* d = dst->words;                                         \
+    const u64* x = a->words;                                     \
+    const u64* y = b->words;                                     \
+    usize n = bitset_word_count(a->count);                       \
+    usize i = 0;                                                 \
+    BITSET_VECTOR_OP(d, x, y, n, i, op256, op128)                \
+    for (; i < n; i++) d[i] = x[i] op y[i];                      \
+  }
+
+BITSET_DEFINE_OP(and, &, _mm256_and_si256, _mm_and_si128)
+BITSET_DEFINE_OP(or, |, _mm256_or_si256, _mm_or_si128)
+BITSET_DEFINE_OP(xor, ^, _mm256_xor_si256, _mm_xor_si128)
+BITSET_DEFINE_OP(andnot, &~, bitset_andnot256, bitset_andnot128)
+
+#ifdef __AVX2__
+// Nibble lookup with pshufb, summed per 64 bit lane with psadbw
+static inline __m256i bitset_popcount256(__m256i v) {
+  const __m256i lookup =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0F);
+  __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+  __m256i hi = _mm256_shuffle_epi8(
+      lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+  return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+#elif defined(__SSE2__) && !defined(__POPCNT__)
+// Without a popcount instruction the builtin is a call per word, this
+// counts two words at once with the same bit tricks
+static inline __m128i bitset_popcount128(__m128i v) {
+  const __m128i m1 = _mm_set1_epi8(0x55);
+  const __m128i m2 = _mm_set1_epi8(0x33);
+  const __m128i m4 = _mm_set1_epi8(0x0F);
+  v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+  v = _mm_add_epi8(_mm_and_si128(v, m2),
+                   _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+  v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+  return _mm_sad_epu8(v, _mm_setzero_si128());
+}
+#endif
+
+static usize bitset_popcount_words(const u64* words, usize n) {
+  usize count = 0;
+  usize i = 0;
+#ifdef __AVX2__
+  __m256i sum = _mm256_setzero_si256();
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)&words[i]);
+    sum = _mm256_add_epi64(sum, bitset_popcount256(v));
+  }
+  count = (usize)_mm256_extract_epi64(sum, 0) +
+          (usize)_mm256_extract_epi64(sum, 1) +
+          (usize)_mm256_extract_epi64(sum, 2) +
+          (usize)_mm256_extract_epi64(sum, 3);
+#elif defined(__SSE2__) && !defined(__POPCNT__)
+  __m128i sum = _mm_setzero_si128();
+  for (; i + 2 <= n; i += 2) {
+    __m128i v = _mm_loadu_si128((const __m128i*)&words[i]);
+    sum = _mm_add_epi64(sum, bitset_popcount128(v));
+  }
+  u64 lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, sum);
+  count = (usize)(lanes[0] + lanes[1]);
+#endif
+  for (; i < n; i++) count += (usize)__builtin_popcountll(words[i]);
+  return count;
+}
+
+usize bitset_popcount(const bitset_t* b) {
+  return bitset_popcount_words(b->words, bitset_word_count(b->count));
+}
+
+void bitset_build_rank(bitset_t* b) {
+  usize n = bitset_word_count(b->count);
+  if (b->ranks == NULL) {
+    b->ranks = stdr_alloc(b->allocator, bitset_rank_count(b) * sizeof(usize));
+  }
+  usize count = 0;
+  for (usize j = 0; j < bitset_rank_count(b); j++) {
+    b->ranks[j] = count;
+    usize w = j * BITSET_RANK_WORDS;
+    usize end = w + BITSET_RANK_WORDS < n ? w + BITSET_RANK_WORDS : n;
+    if (w < end) count += bitset_popcount_words(&b->words[w], end - w);
+  }
+}
+
+usize bitset_rank(const bitset_t* b, usize i) {
+  STDR_ASSERT(b->ranks != NULL && i <= b->count);
+  usize w = i / 64;
+  usize rank = b->ranks[w / BITSET_RANK_WORDS];
+  for (usize j = w - w % BITSET_RANK_WORDS; j < w; j++) {
+    rank += (usize)__builtin_popcountll(b->words[j]);
+  }
+  if (i % 64 != 0) {
+    u64 below = ((u64)1 << (i % 64)) - 1;
+    rank += (usize)__builtin_popcountll(b->words[w] & below);
+  }
+  return rank;
+}
+
+usize bitset_select(const bitset_t* b, usize k) {
+  STDR_ASSERT(b->ranks != NULL);
+  usize blocks = bitset_rank_count(b);
+  if (k >= b->ranks[blocks - 1]) return (usize)-1;
+
+  // Last block that starts at or below rank k
+  usize lo = 0;
+  usize hi = blocks - 1;
+  while (hi - lo > 1) {
+    usize mid = lo + (hi - lo) / 2;
+    if (b->ranks[mid] <= k) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  k -= b->ranks[lo];
+  usize w = lo * BITSET_RANK_WORDS;
+  for (;; w++) {
+    usize count = (usize)__builtin_popcountll(b->words[w]);
+    if (k < count) break;
+    k -= count;
+  }
+  u64 word = b->words[w];
+  for (; k > 0; k--) word &= word - 1;
+  return w * 64 + (usize)__builtin_ctzll(word);
+}
+
+#endif  // STDR_BITSET_IMPLEMENTATION
+#undef STDR_BITSET_IMPLEMENTATION
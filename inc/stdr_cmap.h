@@ -0,0 +1,172 @@
+#ifndef STDR_CMAP_H_
+#define STDR_CMAP_H_
+
+#include <pthread.h>
+
+#include "stdr.h"
+
+// Concurrent map: a power of two of independently locked map(T) shards. The
+// key is hashed once outside of any lock, the high hash bits pick the shard
+// and the low bits probe inside it.
+//
+// The header, the shards and the shard maps all come from STDR_MALLOC and
+// STDR_FREE whatever the current allocator is: shards grow from different
+// threads and arenas are not thread safe.
+typedef struct {
+  _Alignas(64) pthread_mutex_t lock;
+  map(void) map;
+} cmap_shard_t;
+
+typedef struct {
+  usize item_size;
+  usize shard_count;
+  u64 seed;
+  cmap_shard_t* shards;
+} cmap_header_t;
+
+#define cmap(T) T*
+
+#define cmap_header(m) ((cmap_header_t*)m - 1)
+#define cmap_shard_count(m) (cmap_header(m)->shard_count)
+
+#ifndef CMAP_DEFAULT_SHARDS
+#define CMAP_DEFAULT_SHARDS 256
+#endif
+
+cmap(void) cmap_alloc(usize item_size, usize shard_count);
+void cmap_free(cmap(void) m);
+usize cmap_count(cmap(void) m);
+
+#define cmap_init(m, shard_count) \
+  ((m) = cmap_alloc(sizeof(*(m)), shard_count))
+
+// Copies the value into dst, values may move as soon as the lock is released
+bool cmap_get(cmap(void) m, str_t k, void* dst);
+void cmap_insert_cpy(cmap(void) m, str_t k, const void* data);
+// Adds n to an integer value, a missing key starts at zero. Returns the new
+// value.
+i64 cmap_increment(cmap(void) m, str_t k, i64 n);
+
+#define cmap_insert(m, k, ...)                      \
+  do {                                              \
+    typeof(*(m)) cmap_insert_value = (__VA_ARGS__); \
+    cmap_insert_cpy(m, k, &cmap_insert_value);      \
+  } while (0)
+
+// Not synchronised, call once all writers are done. Like map_items_collect
+// the pairs are valid until the map is freed or changed.
+#define cmap_items_collect(m, dst)                                         \
+  for (usize cmap_items_i = 0; cmap_items_i < cmap_shard_count(m);         \
+       cmap_items_i++) {                                                   \
+    typeof(m) cmap_items_shard = cmap_header(m)->shards[cmap_items_i].map; \
+    map_items_collect(cmap_items_shard, dst);                              \
+  }
+
+#endif  // STDR_CMAP_H_
+
+#ifdef STDR_CMAP_IMPLEMENTATION
+
+static inline usize cmap_bytes(usize shard_count) {
+  return sizeof(cmap_header_t) + (shard_count + 1) * sizeof(cmap_shard_t);
+}
+
+cmap(void) cmap_alloc(usize item_size, usize shard_count) {
+  if (shard_count == 0) shard_count = CMAP_DEFAULT_SHARDS;
+  usize n = 1;
+  while (n < shard_count) n *= 2;
+
+  // One block with the shards after the header, rounded up to their
+  // alignment. The extra shard covers the padding.
+  cmap_header_t* m = stdr_alloc(NULL, cmap_bytes(n));
+  m->item_size = item_size;
+  m->shard_count = n;
+  m->seed = stdr_hash_seed();
+  usize pad = (usize)-(uintptr_t)(m + 1) & (_Alignof(cmap_shard_t) - 1);
+  m->shards = (cmap_shard_t*)((u8*)(m + 1) + pad);
+  stdr_allocator_t* prev = stdr_allocator_set(NULL);
+  for (usize i = 0; i < n; i++) {
+    pthread_mutex_init(&m->shards[i].lock, NULL);
+    m->shards[i].map = map_alloc(item_size, 0, 0);
+    map_header(m->shards[i].map)->seed = m->seed;
+  }
+  stdr_allocator_set(prev);
+  return m + 1;
+}
+
+void cmap_free(cmap(void) m) {
+  if (m == NULL) return;
+  for (usize i = 0; i < cmap_shard_count(m); i++) {
+    pthread_mutex_destroy(&cmap_header(m)->shards[i].lock);
+    map_free(cmap_header(m)->shards[i].map);
+  }
+  stdr_free(NULL, cmap_header(m), cmap_bytes(cmap_shard_count(m)));
+}
+
+usize cmap_count(cmap(void) m) {
+  usize count = 0;
+  for (usize i = 0; i < cmap_shard_count(m); i++) {
+    cmap_shard_t* s = &cmap_header(m)->shards[i];
+    pthread_mutex_lock(&s->lock);
+    count += map_count(s->map);
+    pthread_mutex_unlock(&s->lock);
+  }
+  return count;
+}
+
+static cmap_shard_t* cmap_shard(cmap(void) m, usize hash) {
+  usize bits = (usize)__builtin_ctzll(cmap_shard_count(m));
+  if (bits == 0) return cmap_header(m)->shards;
+  return &cmap_header(m)->shards[hash >> (sizeof(usize) * 8 - bits)];
+}
+
+bool cmap_get(cmap(void) m, str_t k, void* dst) {
+  usize hash = STDR_HASH_SEEDED(k, cmap_header(m)->seed);
+  cmap_shard_t* s = cmap_shard(m, hash);
+
+  pthread_mutex_lock(&s->lock);
+  usize i = map_lookup(s->map, k, hash);
+  if (i != (usize)-1) {
+    memcpy(dst, &((u8*)s->map)[i * map_item_size(s->map)],
+           (size_t)map_item_size(s->map));
+  }
+  pthread_mutex_unlock(&s->lock);
+  return i != (usize)-1;
+}
+
+void cmap_insert_cpy(cmap(void) m, str_t k, const void* data) {
+  usize hash = STDR_HASH_SEEDED(k, cmap_header(m)->seed);
+  cmap_shard_t* s = cmap_shard(m, hash);
+
+  pthread_mutex_lock(&s->lock);
+  bool inserted;
+  usize i = map_upsert(&s->map, k, hash, &inserted);
+  memcpy(&((u8*)s->map)[i * map_item_size(s->map)], data,
+         (size_t)map_item_size(s->map));
+  pthread_mutex_unlock(&s->lock);
+}
+
+i64 cmap_increment(cmap(void) m, str_t k, i64 n) {
+  usize item_size = cmap_header(m)->item_size;
+  STDR_ASSERT(item_size == sizeof(i64) || item_size == sizeof(i32));
+
+  usize hash = STDR_HASH_SEEDED(k, cmap_header(m)->seed);
+  cmap_shard_t* s = cmap_shard(m, hash);
+
+  pthread_mutex_lock(&s->lock);
+  bool inserted;
+  usize i = map_upsert(&s->map, k, hash, &inserted);
+  void* value = &((u8*)s->map)[i * item_size];
+  i64 result;
+  if (item_size == sizeof(i64)) {
+    if (inserted) *(i64*)value = 0;
+    result = *(i64*)value += n;
+  } else {
+    if (inserted) *(i32*)value = 0;
+    result = *(i32*)value += (i32)n;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return result;
+}
+
+#endif  // STDR_CMAP_IMPLEMENTATION
+#undef STDR_CMAP_IMPLEMENTATION
@@ -84,7 +84,7 @@ void stdr_flag_i64(i64* dst, str_t name, str_t desciption) {
 
 void stdr_flag_print(const cstr_t program, FILE* file) {
   fprintf(file, "usage: %s [options]\n", program);
-  for (isize i = 0; i < arr_count(ctx.flags); i++) {
+  for (usize i = 0; i < arr_count(ctx.flags); i++) {
     stdr_flag_t f = ctx.flags[i];
     switch (f.kind) {
       case FK_BOOL: {
@@ -126,7 +126,7 @@ void stdr_flag_parse(i32 argc, const cstr_t argv[]) {
     if (arg.ptr[0] != '-') continue;
     arg = str_drop(arg, 1);
 
-    for (isize j = 0; j < arr_count(ctx.flags); j++) {
+    for (usize j = 0; j < arr_count(ctx.flags); j++) {
       stdr_flag_t f = ctx.flags[j];
 
       if (str_eq(arg, f.name)) {
@@ -0,0 +1,243 @@
+#ifndef STDR_MAPFILE_H_
+#define STDR_MAPFILE_H_
+
+#include "stdr.h"
+
+// Read only map(T) file that is probed in place after an mmap. The file is
+// a header, the control bytes and slots of a table built with the same
+// probing as map(T), the values and a blob with the key bytes. Offsets are
+// relative, so opening is an mmap and a bounds check, nothing is parsed or
+// allocated.
+//
+//   mapfile_save(dic, "words.map");
+//   mapfile_t f;
+//   if (mapfile_open(&f, "words.map")) {
+//     const i64* count = mapfile_get(&f, i64, str("the"));
+//     mapfile_close(&f);
+//   }
+//
+// Files use the byte order of the machine that wrote them. A seed check
+// rejects files written with a different hash.
+
+#define MAPFILE_MAGIC "STDRMAP"
+#define MAPFILE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  u32 version;
+  u32 item_size;
+  u64 capacity;
+  u64 count;
+  u64 seed;
+  // STDR_HASH_SEEDED(MAPFILE_MAGIC, seed) of the writer
+  u64 check;
+  // Byte offsets of the sections from the start of the file
+  u64 ctrl;
+  u64 slots;
+  u64 values;
+  u64 keys;
+  u64 size;
+} mapfile_header_t;
+
+typedef struct {
+  u64 hash;
+  // Offset into the key section
+  u64 key;
+  u64 len;
+  // Index into the values
+  u64 value;
+} mapfile_slot_t;
+
+typedef struct {
+  const u8* base;
+  usize size;
+  const mapfile_header_t* header;
+  const u8* ctrl;
+  const mapfile_slot_t* slots;
+  const u8* values;
+  const char* keys;
+} mapfile_t;
+
+// Writes the live entries of m to path. Returns false on IO errors.
+bool mapfile_save(map(void) m, cstr_t path);
+// Maps path read only. Returns false if it cannot be mapped or is not a
+// valid map file.
+bool mapfile_open(mapfile_t* f, cstr_t path);
+void mapfile_close(mapfile_t* f);
+
+const void* mapfile_get_ptr(const mapfile_t* f, str_t k);
+#define mapfile_get(f, T, k) ((const T*)mapfile_get_ptr(f, k))
+#define mapfile_count(f) ((f)->header->count)
+#define mapfile_item_size(f) ((f)->header->item_size)
+
+#endif  // STDR_MAPFILE_H_
+
+#ifdef STDR_MAPFILE_IMPLEMENTATION
+
+#include <fcntl.h>     // open
+#include <stdio.h>     // fopen, fwrite
+#include <sys/mman.h>  // mmap, munmap
+#include <sys/stat.h>  // fstat
+#include <unistd.h>    // close
+
+#define mapfile_align(n) (((n) + 15) & ~(u64)15)
+
+bool mapfile_save(map(void) m, cstr_t path) {
+  STDR_ASSERT(m != NULL);
+  map_migrate_all(m);
+
+  mapfile_header_t h = {0};
+  memcpy(h.magic, MAPFILE_MAGIC, sizeof(MAPFILE_MAGIC));
+  h.version = MAPFILE_VERSION;
+  h.item_size = (u32)map_item_size(m);
+  h.count = map_count(m);
+  h.capacity = map_capacity_for(map_count(m));
+  h.seed = map_header(m)->seed;
+  h.check = STDR_HASH_SEEDED(STR(MAPFILE_MAGIC), h.seed);
+
+  u64 key_bytes = 0;
+  for (usize i = 0; i < map_end(m); i++) {
+    if (map_live(m, i)) key_bytes += map_entries(m)[i].len;
+  }
+  h.ctrl = mapfile_align(sizeof(mapfile_header_t));
+  h.slots = mapfile_align(h.ctrl + h.capacity);
+  h.values = h.slots + h.capacity * sizeof(mapfile_slot_t);
+  h.keys = mapfile_align(h.values + h.count * h.item_size);
+  h.size = h.keys + key_bytes;
+
+  u8* buf = calloc(1, (size_t)h.size);
+  memcpy(buf, &h, sizeof(h));
+  u8* ctrl = &buf[h.ctrl];
+  mapfile_slot_t* slots = (mapfile_slot_t*)&buf[h.slots];
+  memset(ctrl, MAP_CTRL_EMPTY, (size_t)h.capacity);
+
+  // Same placement as map_claim on a table without tombstones
+  usize groups = (usize)h.capacity / MAP_GROUP_WIDTH;
+  u64 value = 0;
+  u64 key = 0;
+  for (usize i = 0; i < map_end(m); i++) {
+    if (!map_live(m, i)) continue;
+    map_entry_t* e = &map_entries(m)[i];
+    usize g = (e->hash >> 7) & (groups - 1);
+    u32 avail;
+    for (usize step = 1;; step++) {
+      avail = map_group_match_empty(&ctrl[g * MAP_GROUP_WIDTH]);
+      if (avail != 0) break;
+      g = (g + step) & (groups - 1);
+    }
+    usize slot = g * MAP_GROUP_WIDTH + (usize)__builtin_ctz(avail);
+    ctrl[slot] = (u8)(e->hash & 0x7F);
+    slots[slot] = (mapfile_slot_t){e->hash, key, e->len, value};
+
+    memcpy(&buf[h.values + value * h.item_size], &((u8*)m)[i * h.item_size],
+           (size_t)h.item_size);
+    memcpy(&buf[h.keys + key], map_entry_key(e).ptr, (size_t)e->len);
+    value += 1;
+    key += e->len;
+  }
+
+  FILE* file = fopen(path, "wb");
+  bool ok = file != NULL && fwrite(buf, 1, (size_t)h.size, file) == h.size;
+  if (file != NULL) ok = fclose(file) == 0 && ok;
+  free(buf);
+  return ok;
+}
+
+// Files are untrusted. Every offset is checked against the size before it
+// is used, and section lengths are compared by subtraction so that no sum
+// can wrap.
+static bool mapfile_valid(const mapfile_t* f) {
+  const mapfile_header_t* h = f->header;
+  if (memcmp(h->magic, MAPFILE_MAGIC, sizeof(MAPFILE_MAGIC)) != 0) {
+    return false;
+  }
+  if (h->version != MAPFILE_VERSION || h->size != f->size) return false;
+  if (h->check != STDR_HASH_SEEDED(STR(MAPFILE_MAGIC), h->seed)) return false;
+
+  if (h->ctrl > h->size || h->slots > h->size || h->values > h->size ||
+      h->keys > h->size) {
+    return false;
+  }
+  if (h->ctrl < sizeof(mapfile_header_t) || h->slots < h->ctrl ||
+      h->values < h->slots || h->keys < h->values) {
+    return false;
+  }
+  // The mapping is page aligned, slots and values are read in place
+  if (h->slots % _Alignof(mapfile_slot_t) != 0 || h->values % 16 != 0) {
+    return false;
+  }
+
+  // Probing needs a power of two of whole groups and at least one empty slot
+  if (h->capacity < MAP_GROUP_WIDTH) return false;
+  if ((h->capacity & (h->capacity - 1)) != 0) return false;
+  if (h->capacity > h->slots - h->ctrl) return false;
+  if (h->capacity > (h->values - h->slots) / sizeof(mapfile_slot_t)) {
+    return false;
+  }
+  if (h->count >= MAP_MAX_LOAD(h->capacity)) return false;
+  return h->item_size == 0 || h->count <= (h->keys - h->values) / h->item_size;
+}
+
+bool mapfile_open(mapfile_t* f, cstr_t path) {
+  *f = (mapfile_t){0};
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (usize)st.st_size < sizeof(mapfile_header_t)) {
+    close(fd);
+    return false;
+  }
+  void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return false;
+
+  f->base = base;
+  f->size = (usize)st.st_size;
+  f->header = base;
+  if (!mapfile_valid(f)) {
+    mapfile_close(f);
+    return false;
+  }
+  f->ctrl = &f->base[f->header->ctrl];
+  f->slots = (const mapfile_slot_t*)&f->base[f->header->slots];
+  f->values = &f->base[f->header->values];
+  f->keys = (const char*)&f->base[f->header->keys];
+  return true;
+}
+
+void mapfile_close(mapfile_t* f) {
+  if (f->base != NULL) munmap((void*)f->base, (size_t)f->size);
+  *f = (mapfile_t){0};
+}
+
+const void* mapfile_get_ptr(const mapfile_t* f, str_t k) {
+  const mapfile_header_t* h = f->header;
+  usize hash = STDR_HASH_SEEDED(k, h->seed);
+  usize groups = (usize)h->capacity / MAP_GROUP_WIDTH;
+  usize g = (hash >> 7) & (groups - 1);
+  u64 key_bytes = h->size - h->keys;
+
+  // Bounded, a corrupt control array may have no empty slot
+  for (usize step = 1; step <= groups; step++) {
+    const u8* ctrl = &f->ctrl[g * MAP_GROUP_WIDTH];
+    u32 match = map_group_match(ctrl, (u8)(hash & 0x7F));
+    while (match != 0) {
+      const mapfile_slot_t* s =
+          &f->slots[g * MAP_GROUP_WIDTH + (usize)__builtin_ctz(match)];
+      match &= match - 1;
+      if (s->hash != hash || s->len != k.len) continue;
+      if (s->key > key_bytes || s->len > key_bytes - s->key) return NULL;
+      if (s->value >= h->count) return NULL;
+      if (memcmp(&f->keys[s->key], k.ptr, (size_t)k.len) == 0) {
+        return &f->values[s->value * h->item_size];
+      }
+    }
+    if (map_group_match_empty(ctrl) != 0) return NULL;
+    g = (g + step) & (groups - 1);
+  }
+  return NULL;
+}
+
+#endif  // STDR_MAPFILE_IMPLEMENTATION
+#undef STDR_MAPFILE_IMPLEMENTATION
@@ -0,0 +1,56 @@
+#ifndef STDR_PHF_H_
+#define STDR_PHF_H_
+
+#include "stdr.h"
+
+// Minimal perfect hash over a fixed key set, hash and displace (CHD) style.
+// tools/phf_gen builds the tables at compile time and emits them as a header
+// with a `static const phf_t <name>_phf`. A key hashes to a bucket, the
+// bucket's displacement picks its slot and the key stored in that slot is
+// compared once:
+//
+//   #include "words_phf.h"
+//   usize i = phf_index(&words_phf, str("zorro"));
+//   if (i != (usize)-1) words_phf.keys[i] ...
+//
+// Slots are 0 .. count and hold every key exactly once, so they can index
+// arrays of per-key data. The tables always use stdr_hash, STDR_HASH and
+// STDR_HASH_SEEDED do not apply.
+
+typedef struct {
+  usize count;
+  usize bucket_count;
+  u64 seed;
+  const u32* disp;
+  // Keys in slot order, NUL terminated but may contain NUL themselves
+  const char* const* keys;
+  const u32* lens;
+} phf_t;
+
+// Keys per bucket on average. Larger buckets give smaller tables but need
+// more attempts to displace.
+#define PHF_BUCKET_SIZE 4
+
+static inline usize phf_bucket(u64 hash, usize bucket_count) {
+  return (usize)(((hash >> 32) * (u64)bucket_count) >> 32);
+}
+
+static inline usize phf_slot(u64 hash, u32 disp, usize count) {
+  return (usize)(((u64)(u32)stdr_hash_u64(hash, disp) * (u64)count) >> 32);
+}
+
+// Slot of k, or (usize)-1 if k is not in the set
+static inline usize phf_index(const phf_t* p, str_t k) {
+  if (p->count == 0) return (usize)-1;
+  u64 hash = stdr_hash(k, p->seed);
+  usize i = phf_slot(hash, p->disp[phf_bucket(hash, p->bucket_count)],
+                     p->count);
+  if (p->lens[i] != k.len || memcmp(p->keys[i], k.ptr, (size_t)k.len) != 0) {
+    return (usize)-1;
+  }
+  return i;
+}
+
+#define phf_has(p, k) (phf_index(p, k) != (usize)-1)
+
+#endif  // STDR_PHF_H_
@@ -0,0 +1,255 @@
+#ifndef STDR_RING_H_
+#define STDR_RING_H_
+
+#include <stdatomic.h>
+
+#include "stdr.h"
+
+// Queues. ring_t is a fixed capacity single producer, single consumer ring
+// for handing items between two threads without a lock:
+//
+//   ring_t r;
+//   ring_init(&r, sizeof(chunk_t), 1024);
+//   // producer                      // consumer
+//   while (!ring_push(&r, &chunk));  while (!ring_pop(&r, &chunk));
+//   ring_free(&r);
+//
+// Each side owns one index and keeps a cached copy of the other one, on its
+// own cache line, so a push or pop only touches shared memory when the
+// cached index says the ring is full or empty. The fields are cache line
+// aligned, so a ring_t on the heap has to come from
+// aligned_alloc(STDR_CACHE_LINE, sizeof(ring_t)) rather than malloc.
+//
+// deque(T) is a growable double ended queue for one thread with a header
+// like arr(T):
+//
+//   deque(i64) d = NULL;
+//   deque_push_back(d, 1);
+//   deque_push_front(d, 0);
+//   i64 first = deque_pop_front(d);
+//   deque_free(d);
+
+#define STDR_CACHE_LINE 64
+
+typedef struct {
+  // Written by the consumer
+  _Alignas(STDR_CACHE_LINE) _Atomic usize head;
+  usize tail_cache;
+  // Written by the producer
+  _Alignas(STDR_CACHE_LINE) _Atomic usize tail;
+  usize head_cache;
+  // Read only after ring_init
+  _Alignas(STDR_CACHE_LINE) usize mask;
+  usize item_size;
+  u8* items;
+  stdr_allocator_t* allocator;
+} ring_t;
+
+// Capacity is rounded up to a power of two, items come from the current
+// allocator
+void ring_init(ring_t* r, usize item_size, usize capacity);
+void ring_free(ring_t* r);
+
+#define ring_capacity(r) ((r)->mask + 1)
+
+// Producer only. Returns false if the ring is full.
+static inline bool ring_push(ring_t* r, const void* item) {
+  usize tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  if (tail - r->head_cache > r->mask) {
+    r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - r->head_cache > r->mask) return false;
+  }
+  memcpy(&r->items[(tail & r->mask) * r->item_size], item,
+         (size_t)r->item_size);
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+// Consumer only. Returns false if the ring is empty.
+static inline bool ring_pop(ring_t* r, void* dst) {
+  usize head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  if (head == r->tail_cache) {
+    r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head == r->tail_cache) return false;
+  }
+  memcpy(dst, &r->items[(head & r->mask) * r->item_size],
+         (size_t)r->item_size);
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+  return true;
+}
+
+// Batched versions, one index update for up to n items. Return the number
+// of items moved.
+usize ring_push_n(ring_t* r, const void* items, usize n);
+usize ring_pop_n(ring_t* r, void* dst, usize n);
+
+// Either side, only a snapshot while the other side is running
+usize ring_count(ring_t* r);
+
+// Padded to 16 bytes, like the arr header the items follow it directly
+typedef struct {
+  _Alignas(16) usize head;
+  usize count;
+  // Always a power of two
+  usize capacity;
+  usize item_size;
+  stdr_allocator_t* allocator;
+} deque_header_t;
+
+#define deque(T) T*
+
+#define deque_header(d) ((deque_header_t*)(d) - 1)
+#define deque_count(d) ((d) == NULL ? 0 : deque_header(d)->count)
+#define deque_capacity(d) ((d) == NULL ? 0 : deque_header(d)->capacity)
+
+// Room for one more item
+deque(void) deque_grow(deque(void) d, usize item_size);
+void deque_free(deque(void) d);
+
+// Slot of the i-th item from the front
+#define deque_slot(d, i) \
+  ((deque_header(d)->head + (i)) & (deque_header(d)->capacity - 1))
+#define deque_at(d, i) ((d)[deque_slot(d, i)])
+#define deque_front(d) deque_at(d, 0)
+#define deque_back(d) deque_at(d, deque_count(d) - 1)
+
+#define deque_push_back(d, ...)                                 \
+  do {                                                          \
+    if (deque_count(d) == deque_capacity(d))                    \
+      (d) = deque_grow(d, sizeof(*(d)));                        \
+    (d)[deque_slot(d, deque_header(d)->count)] = (__VA_ARGS__); \
+    deque_header(d)->count += 1;                                \
+  } while (0)
+
+#define deque_push_front(d, ...)                                          \
+  do {                                                                    \
+    if (deque_count(d) == deque_capacity(d))                              \
+      (d) = deque_grow(d, sizeof(*(d)));                                  \
+    deque_header(d)->head = deque_slot(d, deque_header(d)->capacity - 1); \
+    deque_header(d)->count += 1;                                          \
+    (d)[deque_header(d)->head] = (__VA_ARGS__);                           \
+  } while (0)
+
+// Slot of the removed item, it stays valid until the next push
+static inline usize deque_pop_front_slot(deque(void) d) {
+  deque_header_t* h = deque_header(d);
+  STDR_ASSERT(h->count > 0);
+  usize i = h->head;
+  h->head = (h->head + 1) & (h->capacity - 1);
+  h->count -= 1;
+  return i;
+}
+
+static inline usize deque_pop_back_slot(deque(void) d) {
+  deque_header_t* h = deque_header(d);
+  STDR_ASSERT(h->count > 0);
+  h->count -= 1;
+  return (h->head + h->count) & (h->capacity - 1);
+}
+
+#define deque_pop_front(d) ((d)[deque_pop_front_slot(d)])
+#define deque_pop_back(d) ((d)[deque_pop_back_slot(d)])
+#define deque_clear(d)                           \
+  do {                                           \
+    if ((d) != NULL) deque_header(d)->count = 0; \
+  } while (0)
+
+#endif  // STDR_RING_H_
+
+#ifdef STDR_RING_IMPLEMENTATION
+
+void ring_init(ring_t* r, usize item_size, usize capacity) {
+  usize n = 1;
+  while (n < capacity) n *= 2;
+  *r = (ring_t){0};
+  r->mask = n - 1;
+  r->item_size = item_size;
+  r->allocator = stdr_allocator_get();
+  r->items = stdr_alloc(r->allocator, n * item_size);
+}
+
+void ring_free(ring_t* r) {
+  stdr_free(r->allocator, r->items, ring_capacity(r) * r->item_size);
+  *r = (ring_t){0};
+}
+
+usize ring_push_n(ring_t* r, const void* items, usize n) {
+  usize tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  if (ring_capacity(r) - (tail - r->head_cache) < n) {
+    r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+  }
+  usize free_count = ring_capacity(r) - (tail - r->head_cache);
+  if (n > free_count) n = free_count;
+  if (n == 0) return 0;
+
+  // Up to the end of the buffer, then from the start
+  usize at = tail & r->mask;
+  usize first = ring_capacity(r) - at < n ? ring_capacity(r) - at : n;
+  memcpy(&r->items[at * r->item_size], items, (size_t)(first * r->item_size));
+  memcpy(r->items, &((const u8*)items)[first * r->item_size],
+         (size_t)((n - first) * r->item_size));
+  atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+  return n;
+}
+
+usize ring_pop_n(ring_t* r, void* dst, usize n) {
+  usize head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  if (r->tail_cache - head < n) {
+    r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+  }
+  usize count = r->tail_cache - head;
+  if (n > count) n = count;
+  if (n == 0) return 0;
+
+  usize at = head & r->mask;
+  usize first = ring_capacity(r) - at < n ? ring_capacity(r) - at : n;
+  memcpy(dst, &r->items[at * r->item_size], (size_t)(first * r->item_size));
+  memcpy(&((u8*)dst)[first * r->item_size], r->items,
+         (size_t)((n - first) * r->item_size));
+  atomic_store_explicit(&r->head, head + n, memory_order_release);
+  return n;
+}
+
+usize ring_count(ring_t* r) {
+  usize head = atomic_load_explicit(&r->head, memory_order_acquire);
+  usize tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  // The producer may have moved on after the head was read
+  usize count = tail - head;
+  return count > ring_capacity(r) ? ring_capacity(r) : count;
+}
+
+static inline usize deque_bytes(usize item_size, usize capacity) {
+  return sizeof(deque_header_t) + item_size * capacity;
+}
+
+deque(void) deque_grow(deque(void) d, usize item_size) {
+  if (d == NULL) {
+    stdr_allocator_t* allocator = stdr_allocator_get();
+    deque_header_t* h = stdr_alloc(allocator, deque_bytes(item_size, 8));
+    *h = (deque_header_t){0, 0, 8, item_size, allocator};
+    return h + 1;
+  }
+
+  deque_header_t* h = deque_header(d);
+  usize old = h->capacity;
+  h = stdr_realloc(h->allocator, h, deque_bytes(item_size, old),
+                   deque_bytes(item_size, 2 * old));
+  h->capacity = 2 * old;
+  // Items that wrapped around move to the new upper half, which is at least
+  // as large as the wrapped part
+  u8* items = (u8*)(h + 1);
+  if (h->head + h->count > old) {
+    usize wrapped = h->head + h->count - old;
+    memcpy(&items[old * item_size], items, (size_t)(wrapped * item_size));
+  }
+  return h + 1;
+}
+
+void deque_free(deque(void) d) {
+  if (d == NULL) return;
+  deque_header_t* h = deque_header(d);
+  stdr_free(h->allocator, h, deque_bytes(h->item_size, h->capacity));
+}
+
+#endif  // STDR_RING_IMPLEMENTATION
+#undef STDR_RING_IMPLEMENTATION
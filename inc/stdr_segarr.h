@@ -0,0 +1,96 @@
+#ifndef STDR_SEGARR_H_
+#define STDR_SEGARR_H_
+
+#include "stdr.h"
+
+// Append only array that never moves its items. Storage is a fixed
+// directory of blocks where block b holds SEGARR_FIRST << b items, so
+// growing allocates one new block and copies nothing, and pointers to items
+// stay valid until segarr_free. Indexing is a count of leading zeros and
+// two loads.
+//
+//   segarr(str_t) tokens = NULL;
+//   segarr_append(tokens, str("the"));
+//   str_t* first = segarr_at(tokens, 0);
+//   for (usize i = 0; i < segarr_count(tokens); i++) *segarr_at(tokens, i) ...
+//   segarr_free(tokens);
+//
+// Like arr(T), the directory sits behind a header and blocks come from the
+// allocator that was current when the array was created.
+
+#define SEGARR_FIRST_SHIFT 4
+#define SEGARR_FIRST ((usize)1 << SEGARR_FIRST_SHIFT)
+// Enough blocks for any usize index
+#define SEGARR_BLOCKS (64 - SEGARR_FIRST_SHIFT)
+
+typedef struct {
+  usize count;
+  usize item_size;
+  stdr_allocator_t* allocator;
+} segarr_header_t;
+
+#define segarr(T) T**
+
+#define segarr_header(s) ((segarr_header_t*)(s) - 1)
+#define segarr_count(s) ((s) == NULL ? 0 : segarr_header(s)->count)
+
+static inline usize segarr_block(usize i) {
+  unsigned long long j = (unsigned long long)(i + SEGARR_FIRST);
+  return (usize)(63 - __builtin_clzll(j)) - SEGARR_FIRST_SHIFT;
+}
+
+static inline usize segarr_offset(usize i) {
+  return i + SEGARR_FIRST - (SEGARR_FIRST << segarr_block(i));
+}
+
+static inline usize segarr_block_bytes(const segarr_header_t* h, usize b) {
+  return (SEGARR_FIRST << b) * h->item_size;
+}
+
+static inline segarr(void) segarr_alloc(usize item_size) {
+  stdr_allocator_t* allocator = stdr_allocator_get();
+  segarr_header_t* h = stdr_alloc(
+      allocator, sizeof(segarr_header_t) + SEGARR_BLOCKS * sizeof(void*));
+  *h = (segarr_header_t){0, item_size, allocator};
+  memset(h + 1, 0, SEGARR_BLOCKS * sizeof(void*));
+  return (segarr(void))(h + 1);
+}
+
+static inline void segarr_free_blocks(segarr(void) s) {
+  if (s == NULL) return;
+  segarr_header_t* h = segarr_header(s);
+  for (usize b = 0; b < SEGARR_BLOCKS && s[b] != NULL; b++) {
+    stdr_free(h->allocator, s[b], segarr_block_bytes(h, b));
+  }
+  stdr_free(h->allocator, h,
+            sizeof(segarr_header_t) + SEGARR_BLOCKS * sizeof(void*));
+}
+
+// Slot for one more item, allocating the next block when the last is full
+static inline void* segarr_push(segarr(void) s) {
+  segarr_header_t* h = segarr_header(s);
+  usize i = h->count;
+  usize b = segarr_block(i);
+  if (s[b] == NULL) s[b] = stdr_alloc(h->allocator, segarr_block_bytes(h, b));
+  h->count = i + 1;
+  return &((u8*)s[b])[segarr_offset(i) * h->item_size];
+}
+
+#define segarr_at(s, i) (&(s)[segarr_block(i)][segarr_offset(i)])
+#define segarr_last(s) (*segarr_at(s, segarr_count(s) - 1))
+
+#define segarr_append(s, ...)                                      \
+  do {                                                             \
+    if ((s) == NULL) (s) = (typeof(s))segarr_alloc(sizeof(**(s))); \
+    *(typeof(*(s)))segarr_push((segarr(void))(s)) = (__VA_ARGS__); \
+  } while (0)
+
+// Drops the items but keeps the blocks for reuse
+#define segarr_clear(s)                           \
+  do {                                            \
+    if ((s) != NULL) segarr_header(s)->count = 0; \
+  } while (0)
+
+#define segarr_free(s) segarr_free_blocks((segarr(void))(s))
+
+#endif  // STDR_SEGARR_H_
@@ -0,0 +1,439 @@
+#ifndef STDR_SORT_H_
+#define STDR_SORT_H_
+
+#include "stdr.h"
+
+// Sorts generated per element type, so the comparison is inlined and
+// elements are moved as T instead of byte by byte like qsort does.
+//
+//   STDR_SORT_DEFINE(name, T, less)
+//
+// defines name_sort(T* a, usize n), an introsort: quicksort with a median of
+// three pivot, insertion sort below STDR_SORT_INSERTION items and heapsort
+// once the recursion gets too deep. less(a, b) compares two T values and may
+// be a macro. Not stable.
+//
+//   STDR_RADIX_SORT_DEFINE(name, T, key)
+//
+// defines name_sort(T* a, usize n), a stable LSD radix sort on the u64
+// key(x), one byte per pass. Passes where every key has the same byte are
+// skipped. Needs a buffer of n items from the current allocator.
+//
+//   #define pair_less(a, b) ((a).value > (b).value)
+//   STDR_SORT_DEFINE(pairs, pair_t, pair_less)
+//   pairs_sort(acc, arr_count(acc));
+
+// Stable parallel merge sort for qsort style comparators: the array is
+// split into one run per thread, the runs are merge sorted and then merged
+// pairwise. Every merge round is split across all threads by output
+// position, so the last merges use all cores too. The threads are a pool
+// that lives for one call. Arrays below STDR_SORT_PARALLEL_MIN items are
+// sorted on the calling thread. threads 0 uses every online core. Needs a
+// buffer of n items from the current allocator, STDR_SORT_IMPLEMENTATION in
+// one file and -pthread.
+void stdr_sort_parallel(void* base, usize n, usize size,
+                        int (*cmp)(const void*, const void*), usize threads);
+#define arr_sort_parallel(a, cmp) \
+  stdr_sort_parallel(a, arr_count(a), arr_item_size(a), cmp, 0)
+
+#ifndef STDR_SORT_PARALLEL_MIN
+#define STDR_SORT_PARALLEL_MIN ((usize)1 << 16)
+#endif
+
+#ifndef STDR_SORT_INSERTION
+#define STDR_SORT_INSERTION 16
+#endif
+
+// Radix keys that keep the order of signed integers and floats
+#define stdr_radix_i64(x) ((u64)(i64)(x) ^ ((u64)1 << 63))
+static inline u64 stdr_radix_f64(f64 x) {
+  u64 bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits >> 63 ? ~bits : bits | ((u64)1 << 63);
+}
+
+#define STDR_SORT_DEFINE(name, T, less)                                     \
+  static inline void name##_insertion(T* a, usize n) {                      \
+    for (usize i = 1; i < n; i++) {                                         \
+      T x = a[i];                                                           \
+      usize j = i;                                                          \
+      for (; j > 0 && less(x, a[j - 1]); j--) a[j] = a[j - 1];              \
+      a[j] = x;                                                             \
+    }                                                                       \
+  }                                                                         \
+                                                                            \
+  static inline void name##_sift(T* a, usize i, usize n) {                  \
+    T x = a[i];                                                             \
+    for (usize c = 2 * i + 1; c < n; c = 2 * i + 1) {                       \
+      if (c + 1 < n && less(a[c], a[c + 1])) c++;                           \
+      if (!less(x, a[c])) break;                                            \
+      a[i] = a[c];                                                          \
+      i = c;                                                                \
+    }                                                                       \
+    a[i] = x;                                                               \
+  }                                                                         \
+                                                                            \
+  static inline void name##_heapsort(T* a, usize n) {                       \
+    for (usize i = n / 2; i-- > 0;) name##_sift(a, i, n);                   \
+    for (usize i = n; i-- > 1;) {                                           \
+      T t = a[0];                                                           \
+      a[0] = a[i];                                                          \
+      a[i] = t;                                                             \
+      name##_sift(a, 0, i);                                                 \
+    }                                                                       \
+  }                                                                         \
+                                                                            \
+  /* Hoare partition around the median of a[0], a[n / 2], a[n - 1]. Both */ \
+  /* halves are non empty, a[0 .. p) <= pivot <= a[p .. n). */              \
+  static inline usize name##_partition(T* a, usize n) {                     \
+    usize m = n / 2;                                                        \
+    T t;                                                                    \
+    if (less(a[m], a[0])) t = a[m], a[m] = a[0], a[0] = t;                  \
+    if (less(a[n - 1], a[m])) {                                             \
+      t = a[n - 1], a[n - 1] = a[m], a[m] = t;                              \
+      if (less(a[m], a[0])) t = a[m], a[m] = a[0], a[0] = t;                \
+    }                                                                       \
+    T pivot = a[m];                                                         \
+    usize i = (usize)-1;                                                    \
+    usize j = n;                                                            \
+    for (;;) {                                                              \
+      do i++;                                                               \
+      while (less(a[i], pivot));                                            \
+      do j--;                                                               \
+      while (less(pivot, a[j]));                                            \
+      if (i >= j) return j + 1;                                             \
+      t = a[i], a[i] = a[j], a[j] = t;                                      \
+    }                                                                       \
+  }                                                                         \
+                                                                            \
+  /* Recurses into the smaller half, so the stack stays O(log n) */         \
+  static inline void name##_introsort(T* a, usize n, usize depth) {         \
+    while (n > STDR_SORT_INSERTION) {                                       \
+      if (depth == 0) {                                                     \
+        name##_heapsort(a, n);                                              \
+        return;                                                             \
+      }                                                                     \
+      depth--;                                                              \
+      usize p = name##_partition(a, n);                                     \
+      if (p < n - p) {                                                      \
+        name##_introsort(a, p, depth);                                      \
+        a += p;                                                             \
+        n -= p;                                                             \
+      } else {                                                              \
+        name##_introsort(a + p, n - p, depth);                              \
+        n = p;                                                              \
+      }                                                                     \
+    }                                                                       \
+    name##_insertion(a, n);                                                 \
+  }                                                                         \
+                                                                            \
+  static inline void name##_sort(T* a, usize n) {                           \
+    usize depth = 0;                                                        \
+    for (usize k = n; k > 1; k /= 2) depth += 2;                            \
+    name##_introsort(a, n, depth);                                          \
+  }
+
+#define STDR_RADIX_SORT_DEFINE(name, T, key)                            \
+  static inline void name##_sort(T* a, usize n) {                       \
+    if (n < 2) return;                                                  \
+    usize counts[8][256] = {0};                                         \
+    for (usize i = 0; i < n; i++) {                                     \
+      u64 k = key(a[i]);                                                \
+      for (usize b = 0; b < 8; b++) counts[b][(k >> (8 * b)) & 0xFF]++; \
+    }                                                                   \
+                                                                        \
+    stdr_allocator_t* allocator = stdr_allocator_get();                 \
+    T* tmp = stdr_alloc(allocator, n * sizeof(T));                      \
+    T* src = a;                                                         \
+    T* dst = tmp;                                                       \
+    for (usize b = 0; b < 8; b++) {                                     \
+      usize* c = counts[b];                                             \
+      if (c[(key(src[0]) >> (8 * b)) & 0xFF] == n) continue;            \
+      usize sum = 0;                                                    \
+      for (usize d = 0; d < 256; d++) {                                 \
+        usize count = c[d];                                             \
+        c[d] = sum;                                                     \
+        sum += count;                                                   \
+      }                                                                 \
+      for (usize i = 0; i < n; i++) {                                   \
+        dst[c[(key(src[i]) >> (8 * b)) & 0xFF]++] = src[i];             \
+      }                                                                 \
+      T* t = src;                                                       \
+      src = dst;                                                        \
+      dst = t;                                                          \
+    }                                                                   \
+    if (src != a) memcpy(a, src, (size_t)(n * sizeof(T)));              \
+    stdr_free(allocator, tmp, n * sizeof(T));                           \
+  }
+
+#endif  // STDR_SORT_H_
+
+#ifdef STDR_SORT_IMPLEMENTATION
+
+#include <pthread.h>
+#include <unistd.h>  // sysconf
+
+typedef int (*stdr_cmp_fn)(const void*, const void*);
+
+// Stable merge of a and b into out, ties go to a
+static void stdr_merge(const u8* a, usize na, const u8* b, usize nb, u8* out,
+                       usize size, stdr_cmp_fn cmp) {
+  usize i = 0;
+  usize j = 0;
+  while (i < na && j < nb) {
+    if (cmp(&b[j * size], &a[i * size]) < 0) {
+      memcpy(out, &b[j++ * size], (size_t)size);
+    } else {
+      memcpy(out, &a[i++ * size], (size_t)size);
+    }
+    out += size;
+  }
+  memcpy(out, &a[i * size], (size_t)((na - i) * size));
+  out += (na - i) * size;
+  memcpy(out, &b[j * size], (size_t)((nb - j) * size));
+}
+
+// Bottom up merge sort of a with tmp as the buffer, both n items. Blocks of
+// STDR_SORT_INSERTION items are insertion sorted first, tmp[0] holds the
+// item being moved.
+static void stdr_merge_sort(u8* a, u8* tmp, usize n, usize size,
+                            stdr_cmp_fn cmp) {
+  for (usize b = 0; b < n; b += STDR_SORT_INSERTION) {
+    usize end = b + STDR_SORT_INSERTION < n ? b + STDR_SORT_INSERTION : n;
+    for (usize i = b + 1; i < end; i++) {
+      usize j = i;
+      while (j > b && cmp(&a[i * size], &a[(j - 1) * size]) < 0) j--;
+      if (j == i) continue;
+      memcpy(tmp, &a[i * size], (size_t)size);
+      memmove(&a[(j + 1) * size], &a[j * size], (size_t)((i - j) * size));
+      memcpy(&a[j * size], tmp, (size_t)size);
+    }
+  }
+
+  u8* src = a;
+  u8* dst = tmp;
+  for (usize width = STDR_SORT_INSERTION; width < n; width *= 2) {
+    for (usize b = 0; b < n; b += 2 * width) {
+      usize mid = b + width < n ? b + width : n;
+      usize end = mid + width < n ? mid + width : n;
+      stdr_merge(&src[b * size], mid - b, &src[mid * size], end - mid,
+                 &dst[b * size], size, cmp);
+    }
+    u8* swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != a) memcpy(a, src, (size_t)(n * size));
+}
+
+typedef struct {
+  u8* base;
+  u8* tmp;
+  usize n;
+  usize size;
+  stdr_cmp_fn cmp;
+} stdr_sort_task_t;
+
+// Writes out[begin .. end) of the stable merge of a and b
+typedef struct {
+  const u8* a;
+  usize na;
+  const u8* b;
+  usize nb;
+  u8* out;
+  usize begin;
+  usize end;
+  usize size;
+  stdr_cmp_fn cmp;
+} stdr_merge_task_t;
+
+static void stdr_sort_task(void* arg) {
+  stdr_sort_task_t* t = arg;
+  stdr_merge_sort(t->base, t->tmp, t->n, t->size, t->cmp);
+}
+
+// Number of items taken from a among the first k of the merge. Ties go to
+// a, which keeps the merge stable.
+static usize stdr_merge_corank(const stdr_merge_task_t* t, usize k) {
+  usize lo = k > t->nb ? k - t->nb : 0;
+  usize hi = k < t->na ? k : t->na;
+  while (lo < hi) {
+    usize i = lo + (hi - lo) / 2;
+    usize j = k - i;
+    if (j > 0 && t->cmp(&t->a[i * t->size], &t->b[(j - 1) * t->size]) <= 0) {
+      lo = i + 1;
+    } else {
+      hi = i;
+    }
+  }
+  return lo;
+}
+
+static void stdr_merge_task(void* arg) {
+  stdr_merge_task_t* t = arg;
+  usize size = t->size;
+  usize i = stdr_merge_corank(t, t->begin);
+  usize j = t->begin - i;
+  usize ie = stdr_merge_corank(t, t->end);
+  usize je = t->end - ie;
+  stdr_merge(&t->a[i * size], ie - i, &t->b[j * size], je - j,
+             &t->out[t->begin * size], size, t->cmp);
+}
+
+// Workers wait on work for a round of tasks, claim them one at a time and
+// the last one to finish signals done. The caller works on the round too.
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  void (*fn)(void*);
+  u8* tasks;
+  usize task_size;
+  usize count;
+  usize next;
+  usize pending;
+  bool stop;
+  usize thread_count;
+  pthread_t* threads;
+} stdr_sort_pool_t;
+
+// Called and returns with the lock held
+static void stdr_sort_pool_drain(stdr_sort_pool_t* p) {
+  while (p->next < p->count) {
+    void* task = &p->tasks[p->next++ * p->task_size];
+    pthread_mutex_unlock(&p->lock);
+    p->fn(task);
+    pthread_mutex_lock(&p->lock);
+    if (--p->pending == 0) pthread_cond_signal(&p->done);
+  }
+}
+
+static void* stdr_sort_worker(void* arg) {
+  stdr_sort_pool_t* p = arg;
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!p->stop && p->next >= p->count) {
+      pthread_cond_wait(&p->work, &p->lock);
+    }
+    if (p->stop) break;
+    stdr_sort_pool_drain(p);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+static void stdr_sort_pool_init(stdr_sort_pool_t* p, usize threads) {
+  *p = (stdr_sort_pool_t){0};
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work, NULL);
+  pthread_cond_init(&p->done, NULL);
+  p->thread_count = threads - 1;
+  p->threads = malloc((size_t)p->thread_count * sizeof(*p->threads));
+  for (usize i = 0; i < p->thread_count; i++) {
+    pthread_create(&p->threads[i], NULL, stdr_sort_worker, p);
+  }
+}
+
+static void stdr_sort_pool_run(stdr_sort_pool_t* p, void (*fn)(void*),
+                               void* tasks, usize count, usize task_size) {
+  pthread_mutex_lock(&p->lock);
+  p->fn = fn;
+  p->tasks = tasks;
+  p->task_size = task_size;
+  p->count = count;
+  p->next = 0;
+  p->pending = count;
+  pthread_cond_broadcast(&p->work);
+  stdr_sort_pool_drain(p);
+  while (p->pending > 0) pthread_cond_wait(&p->done, &p->lock);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void stdr_sort_pool_free(stdr_sort_pool_t* p) {
+  pthread_mutex_lock(&p->lock);
+  p->stop = true;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  for (usize i = 0; i < p->thread_count; i++) {
+    pthread_join(p->threads[i], NULL);
+  }
+  free(p->threads);
+  pthread_cond_destroy(&p->done);
+  pthread_cond_destroy(&p->work);
+  pthread_mutex_destroy(&p->lock);
+}
+
+void stdr_sort_parallel(void* base, usize n, usize size,
+                        int (*cmp)(const void*, const void*), usize threads) {
+  if (threads == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cores > 0 ? (usize)cores : 1;
+  }
+  stdr_allocator_t* allocator = stdr_allocator_get();
+  u8* tmp = stdr_alloc(allocator, n * size);
+  if (n < STDR_SORT_PARALLEL_MIN || threads < 2) {
+    stdr_merge_sort(base, tmp, n, size, cmp);
+    stdr_free(allocator, tmp, n * size);
+    return;
+  }
+
+  stdr_sort_pool_t pool;
+  stdr_sort_pool_init(&pool, threads);
+
+  // Run r is [starts[r], starts[r + 1]) and uses the same range of tmp
+  usize runs = threads;
+  usize* starts = malloc((size_t)(runs + 1) * sizeof(*starts));
+  stdr_sort_task_t* sorts = malloc((size_t)runs * sizeof(*sorts));
+  for (usize r = 0; r <= runs; r++) starts[r] = n * r / runs;
+  for (usize r = 0; r < runs; r++) {
+    sorts[r] = (stdr_sort_task_t){(u8*)base + starts[r] * size,
+                                  &tmp[starts[r] * size],
+                                  starts[r + 1] - starts[r], size, cmp};
+  }
+  stdr_sort_pool_run(&pool, stdr_sort_task, sorts, runs, sizeof(*sorts));
+  free(sorts);
+
+  u8* src = base;
+  u8* dst = tmp;
+  arr(stdr_merge_task_t) merges = NULL;
+  while (runs > 1 || src != base) {
+    // Each pair of runs gets threads in proportion to its length. A single
+    // run left in the buffer is merged with nothing, which copies it back.
+    if (runs == 1) dst = base;
+    arr_resize(merges, 0);
+    for (usize r = 0; r < runs; r += 2) {
+      usize begin = starts[r];
+      usize mid = starts[r + 1];
+      usize end = r + 1 < runs ? starts[r + 2] : mid;
+      stdr_merge_task_t t = {&src[begin * size], mid - begin,
+                             &src[mid * size],   end - mid,
+                             &dst[begin * size], 0,
+                             0,                  size,
+                             cmp};
+      usize parts = (end - begin) * threads / n;
+      if (parts == 0) parts = 1;
+      for (usize p = 0; p < parts; p++) {
+        t.begin = (end - begin) * p / parts;
+        t.end = (end - begin) * (p + 1) / parts;
+        arr_append(merges, t);
+      }
+    }
+    stdr_sort_pool_run(&pool, stdr_merge_task, merges, arr_count(merges),
+                       sizeof(*merges));
+
+    usize merged = 0;
+    for (usize r = 0; r < runs; r += 2) starts[merged++] = starts[r];
+    starts[merged] = n;
+    runs = merged;
+    u8* swap = src;
+    src = dst;
+    dst = swap;
+  }
+  stdr_sort_pool_free(&pool);
+  arr_free(merges);
+  stdr_free(allocator, tmp, n * size);
+  free(starts);
+}
+
+#endif  // STDR_SORT_IMPLEMENTATION
+#undef STDR_SORT_IMPLEMENTATION
@@ -0,0 +1,156 @@
+#ifndef STDR_TMAP_H_
+#define STDR_TMAP_H_
+
+#include "stdr.h"
+
+// Maps with fixed size keys (integers, small structs) generated per type:
+//
+//   STDR_TMAP_DEFINE(name, K, V, hash, eq)
+//
+// defines name_t and name_get, name_get_or_insert, name_insert,
+// name_remove, name_reserve and name_free. hash(key, seed) returns a u64 and
+// eq(a, b) a bool. Both may be macros and are expanded in place, so an
+// integer lookup is a folded multiply and one compare per candidate.
+//
+// The probing is the same as for map(T): 16 control bytes per group with
+// 7 bit fingerprints, growth at 7/8 load. Keys and values are stored next
+// to each other in one slot array, which comes from the allocator that was
+// current at the first insert or reserve.
+//
+//   STDR_TMAP_DEFINE(ids, u64, i64, stdr_hash_int, stdr_eq_int)
+//   ids_t m = {0};
+//   ids_insert(&m, 42, 1);
+//   *ids_get_or_insert(&m, 7) += 1;
+//   for (usize i = 0; i < m.capacity; i++)
+//     if (tmap_live(&m, i)) m.items[i].key ...
+//   ids_free(&m);
+
+#define stdr_hash_int(x, seed) stdr_hash_u64((u64)(x), seed)
+#define stdr_eq_int(a, b) ((a) == (b))
+#define stdr_eq_mem(a, b) (memcmp(&(a), &(b), sizeof(a)) == 0)
+
+#define tmap_live(m, i) ((m)->ctrl[i] < MAP_CTRL_EMPTY)
+
+#define STDR_TMAP_DEFINE(name, K, V, hash, eq)                                \
+  typedef struct {                                                            \
+    K key;                                                                    \
+    V value;                                                                  \
+  } name##_item_t;                                                            \
+                                                                              \
+  typedef struct {                                                            \
+    usize count;                                                              \
+    usize capacity;                                                           \
+    usize deleted;                                                            \
+    u64 seed;                                                                 \
+    u8* ctrl;                                                                 \
+    name##_item_t* items;                                                     \
+    stdr_allocator_t* allocator;                                              \
+  } name##_t;                                                                 \
+                                                                              \
+  static inline usize name##_find(const name##_t* m, K key, u64 h) {          \
+    if (m->capacity == 0) return (usize)-1;                                   \
+    usize groups = m->capacity / MAP_GROUP_WIDTH;                             \
+    usize g = (usize)(h >> 7) & (groups - 1);                                 \
+    for (usize step = 1;; step++) {                                           \
+      const u8* ctrl = &m->ctrl[g * MAP_GROUP_WIDTH];                         \
+      u32 match = map_group_match(ctrl, (u8)(h & 0x7F));                      \
+      while (match != 0) {                                                    \
+        usize i = g * MAP_GROUP_WIDTH + (usize)__builtin_ctz(match);          \
+        match &= match - 1;                                                   \
+        if (eq(m->items[i].key, key)) return i;                               \
+      }                                                                       \
+      if (map_group_match_empty(ctrl) != 0) return (usize)-1;                 \
+      g = (g + step) & (groups - 1);                                          \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static inline usize name##_claim(name##_t* m, u64 h) {                      \
+    usize groups = m->capacity / MAP_GROUP_WIDTH;                             \
+    usize g = (usize)(h >> 7) & (groups - 1);                                 \
+    for (usize step = 1;; step++) {                                           \
+      u32 avail = map_group_match_free(&m->ctrl[g * MAP_GROUP_WIDTH]);        \
+      if (avail != 0) {                                                       \
+        usize i = g * MAP_GROUP_WIDTH + (usize)__builtin_ctz(avail);          \
+        if (m->ctrl[i] == MAP_CTRL_DELETED) m->deleted -= 1;                  \
+        m->ctrl[i] = (u8)(h & 0x7F);                                          \
+        return i;                                                             \
+      }                                                                       \
+      g = (g + step) & (groups - 1);                                          \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  static inline void name##_free(name##_t* m) {                               \
+    if (m->capacity != 0) {                                                   \
+      stdr_free(m->allocator, m->ctrl, m->capacity);                          \
+      stdr_free(m->allocator, m->items, m->capacity * sizeof(*m->items));     \
+    }                                                                         \
+    *m = (name##_t){0};                                                       \
+  }                                                                           \
+                                                                              \
+  static inline void name##_rehash(name##_t* m, usize capacity) {             \
+    name##_t n = {0};                                                         \
+    n.capacity = MAP_GROUP_WIDTH;                                             \
+    while (n.capacity < capacity) n.capacity *= 2;                            \
+    n.seed = m->capacity == 0 ? stdr_hash_seed() : m->seed;                   \
+    n.allocator = m->capacity == 0 ? stdr_allocator_get() : m->allocator;     \
+    n.ctrl = stdr_alloc(n.allocator, n.capacity);                             \
+    memset(n.ctrl, MAP_CTRL_EMPTY, (size_t)n.capacity);                       \
+    n.items = stdr_alloc(n.allocator, n.capacity * sizeof(*n.items));         \
+    for (usize i = 0; i < m->capacity; i++) {                                 \
+      if (!tmap_live(m, i)) continue;                                         \
+      n.items[name##_claim(&n, hash(m->items[i].key, n.seed))] = m->items[i]; \
+    }                                                                         \
+    n.count = m->count;                                                       \
+    name##_free(m);                                                           \
+    *m = n;                                                                   \
+  }                                                                           \
+                                                                              \
+  static inline void name##_reserve(name##_t* m, usize count) {               \
+    usize capacity = MAP_GROUP_WIDTH;                                         \
+    while (MAP_MAX_LOAD(capacity) <= count) capacity *= 2;                    \
+    if (capacity > m->capacity) name##_rehash(m, capacity);                   \
+  }                                                                           \
+                                                                              \
+  static inline V* name##_get(const name##_t* m, K key) {                     \
+    if (m->capacity == 0) return NULL;                                        \
+    usize i = name##_find(m, key, hash(key, m->seed));                        \
+    return i == (usize)-1 ? NULL : &m->items[i].value;                        \
+  }                                                                           \
+                                                                              \
+  static inline V* name##_get_or_insert(name##_t* m, K key) {                 \
+    if (m->capacity == 0) name##_rehash(m, 0);                                \
+    u64 h = hash(key, m->seed);                                               \
+    usize i = name##_find(m, key, h);                                         \
+    if (i != (usize)-1) return &m->items[i].value;                            \
+                                                                              \
+    if (m->count + m->deleted >= MAP_MAX_LOAD(m->capacity)) {                 \
+      bool grow = m->count >= MAP_MAX_LOAD(m->capacity) / 2;                  \
+      name##_rehash(m, grow ? m->capacity * 2 : m->capacity);                 \
+    }                                                                         \
+    i = name##_claim(m, h);                                                   \
+    m->count += 1;                                                            \
+    m->items[i].key = key;                                                    \
+    memset(&m->items[i].value, 0, sizeof(V));                                 \
+    return &m->items[i].value;                                                \
+  }                                                                           \
+                                                                              \
+  static inline void name##_insert(name##_t* m, K key, V value) {             \
+    *name##_get_or_insert(m, key) = value;                                    \
+  }                                                                           \
+                                                                              \
+  static inline bool name##_remove(name##_t* m, K key) {                      \
+    if (m->capacity == 0) return false;                                       \
+    usize i = name##_find(m, key, hash(key, m->seed));                        \
+    if (i == (usize)-1) return false;                                         \
+                                                                              \
+    if (map_group_match_empty(&m->ctrl[i - i % MAP_GROUP_WIDTH]) != 0) {      \
+      m->ctrl[i] = MAP_CTRL_EMPTY;                                            \
+    } else {                                                                  \
+      m->ctrl[i] = MAP_CTRL_DELETED;                                          \
+      m->deleted += 1;                                                        \
+    }                                                                         \
+    m->count -= 1;                                                            \
+    return true;                                                              \
+  }
+
+#endif  // STDR_TMAP_H_
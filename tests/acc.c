@@ -12,7 +12,7 @@ typedef struct {
 int pair_cmp(const void* a, const void* b) {
   pair_t _a = *(pair_t*)a;
   pair_t _b = *(pair_t*)b;
-  return (int)(_b.value - _a.value);
+  return (_b.value > _a.value) - (_b.value < _a.value);
 }
 
 void print_first_n(arr(pair_t) acc, usize n) {
@@ -26,8 +26,6 @@ void print_first_n(arr(pair_t) acc, usize n) {
   printf("]\n");
 }
 
-void str_free(str_t s) { free(s.ptr); }
-
 int main(i32 argc, const cstr_t argv[]) {
   (void)argc;
   (void)argv;
@@ -43,16 +41,11 @@ int main(i32 argc, const cstr_t argv[]) {
   for (usize i = 0; i < arr_count(words); i++) {
     str_to_lowercase(words[i]);
 
-    if (map_has(dic, words[i])) {
-      *map_get(dic, words[i]) += 1;
-    } else {
-      map_insert(dic, words[i], 1);
-    }
+    map_increment(dic, words[i], 1);
   }
 
   arr(pair_t) acc = NULL;
-  map_items_collect(dic, acc);
-  arr_sort(acc, pair_cmp);
+  map_top_k(dic, acc, 10, pair_cmp);
 
   print_first_n(acc, 10);
 
@@ -0,0 +1,93 @@
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+
+typedef struct {
+  str_t key;
+  i64 value;
+} pair_t;
+
+bool in_arena(const stdr_arena_t* arena, const void* p) {
+  for (stdr_arena_chunk_t* c = arena->chunks; c != NULL; c = c->next) {
+    if ((const char*)p >= c->data && (const char*)p < c->data + c->size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Tokenise and count with every container block taken from the arena
+i64 count_the(const stdr_arena_t* arena) {
+  dstr_t content = read_file("data/pride_and_prejudice.txt");
+  arr(str_t) words = str_split_words(str(content));
+  map(i64) dic = NULL;
+  map_init(dic, 0, MAP_OWN_KEYS);
+  for (usize i = 0; i < arr_count(words); i++) {
+    str_to_lowercase(words[i]);
+    map_increment(dic, words[i], 1);
+  }
+  arr(pair_t) acc = NULL;
+  map_items_collect(dic, acc);
+
+  STDR_ASSERT(in_arena(arena, arr_header(content)));
+  STDR_ASSERT(in_arena(arena, arr_header(words)));
+  STDR_ASSERT(in_arena(arena, arr_header(acc)));
+  STDR_ASSERT(in_arena(arena, map_header(dic)));
+  STDR_ASSERT(in_arena(arena, map_ctrl(dic)));
+  STDR_ASSERT(in_arena(arena, map_entries(dic)));
+  for (usize i = 0; i < arr_count(acc); i++) {
+    if (acc[i].key.len > MAP_KEY_INLINE) {
+      STDR_ASSERT(in_arena(arena, acc[i].key.ptr));
+    }
+  }
+  return *map_get(dic, STR("the"));
+}
+
+void test_arena(void) {
+  stdr_arena_t arena;
+  stdr_arena_init(&arena, 0, NULL);
+  stdr_allocator_t* prev = stdr_allocator_set(&arena.allocator);
+
+  STDR_ASSERT(count_the(&arena) == 4615);
+  usize chunks = 0;
+  for (stdr_arena_chunk_t* c = arena.chunks; c != NULL; c = c->next) chunks++;
+  STDR_ASSERT(chunks > 1);
+
+  // The second run fits into the merged chunk
+  stdr_arena_reset(&arena);
+  STDR_ASSERT(arena.chunks != NULL && arena.chunks->next == NULL);
+  STDR_ASSERT(count_the(&arena) == 4615);
+  STDR_ASSERT(arena.chunks->next == NULL);
+
+  stdr_allocator_set(prev);
+  arr(u8) a = NULL;
+  arr_append(a, 1);
+  STDR_ASSERT(!in_arena(&arena, arr_header(a)));
+  arr_free(a);
+
+  printf("arena chunks=%zu size=%zu\n", chunks, arena.chunks->size);
+  stdr_arena_free(&arena);
+}
+
+// Only the latest block grows in place
+void test_realloc(void) {
+  stdr_arena_t arena;
+  stdr_arena_init(&arena, 1024, NULL);
+  stdr_allocator_t* a = &arena.allocator;
+  char* p = stdr_alloc(a, 16);
+  memcpy(p, "0123456789abcdef", 16);
+  STDR_ASSERT(stdr_realloc(a, p, 16, 64) == p);
+  char* q = stdr_alloc(a, 16);
+  char* r = stdr_realloc(a, p, 64, 128);
+  STDR_ASSERT(r != p && r > q && memcmp(r, "0123456789abcdef", 16) == 0);
+  stdr_free(a, r, 128);
+  STDR_ASSERT(stdr_alloc(a, 16) == r);
+  stdr_arena_free(&arena);
+}
+
+int main(void) {
+  test_arena();
+  test_realloc();
+  return 0;
+}
@@ -0,0 +1,216 @@
+// mremap is only declared with _GNU_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+
+// Grows past STDR_MMAP_THRESHOLD, so the array moves from malloc to its own
+// mapping and is then grown with mremap
+void test_grow(void) {
+  arr(u64) a = NULL;
+  usize n = 4 * STDR_MMAP_THRESHOLD / sizeof(u64);
+  for (usize i = 0; i < n; i++) arr_append(a, i * i);
+  STDR_ASSERT(arr_count(a) == n);
+  for (usize i = 0; i < n; i++) STDR_ASSERT(a[i] == i * i);
+
+  // Back below the threshold
+  a = arr_realloc(a, 16);
+  STDR_ASSERT(arr_count(a) == 16 && arr_capacity(a) == 16);
+  for (usize i = 0; i < 16; i++) STDR_ASSERT(a[i] == i * i);
+  arr_append(a, 1);
+  STDR_ASSERT(arr_count(a) == 17 && arr_last(a) == 1);
+
+  printf("grow count=%zu\n", n);
+  arr_free(a);
+}
+
+void test_bulk(void) {
+  arr(i32) a = NULL;
+  arr_reserve(a, 100);
+  STDR_ASSERT(arr_count(a) == 0 && arr_capacity(a) == 100);
+  i32* data = a;
+
+  i32 items[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  for (usize i = 0; i < 10; i++) arr_append_n(a, items, 10);
+  STDR_ASSERT(arr_count(a) == 100 && a == data);
+  for (usize i = 0; i < 100; i++) STDR_ASSERT(a[i] == (i32)(i % 10));
+
+  arr_resize(a, 150);
+  STDR_ASSERT(arr_count(a) == 150 && a[99] == 9 && a[149] == 0);
+  arr_resize(a, 5);
+  STDR_ASSERT(arr_count(a) == 5 && a[4] == 4);
+  arr_free(a);
+
+  dstr_t s = NULL;
+  for (usize i = 0; i < 1000; i++) dstr_append_str(&s, STR("ab"));
+  dstr_appendf(&s, "%d-%s", 42, "x");
+  STDR_ASSERT(arr_count(s) == 2004 && s[2004] == '\0');
+  STDR_ASSERT(strcmp(&s[1998], "ab42-x") == 0);
+  dstr_free(s);
+
+  // Size hint plus the terminator, no growth
+  dstr_t content = read_file("data/pride_and_prejudice.txt");
+  FILE* f = fopen("data/pride_and_prejudice.txt", "r");
+  fseek(f, 0, SEEK_END);
+  usize size = (usize)ftell(f);
+  fclose(f);
+  STDR_ASSERT(arr_count(content) == size + 1 && content[size] == '\0');
+  STDR_ASSERT(arr_capacity(content) == size + 1);
+  STDR_ASSERT(strlen(content) == size);
+  dstr_free(content);
+}
+
+int u64_cmp(const void* a, const void* b) {
+  u64 x = *(const u64*)a;
+  u64 y = *(const u64*)b;
+  return (x > y) - (x < y);
+}
+
+// Larger than the swap buffer of the heap
+typedef struct {
+  u64 key;
+  u8 pad[100];
+} big_t;
+
+int big_cmp(const void* a, const void* b) {
+  return u64_cmp(&((const big_t*)a)->key, &((const big_t*)b)->key);
+}
+
+typedef struct {
+  str_t key;
+  i64 value;
+} pair_t;
+
+int pair_cmp(const void* a, const void* b) {
+  i64 x = ((const pair_t*)a)->value;
+  i64 y = ((const pair_t*)b)->value;
+  return (y > x) - (y < x);
+}
+
+void test_top_k(void) {
+  usize n = 10000;
+  arr(u64) a = NULL;
+  for (usize i = 0; i < n; i++) arr_append(a, stdr_hash_u64(i, 1) % 5000);
+  arr(u64) sorted = arr_top_k(a, n, u64_cmp);
+  STDR_ASSERT(arr_count(sorted) == n);
+  for (usize i = 1; i < n; i++) STDR_ASSERT(sorted[i - 1] <= sorted[i]);
+
+  usize ks[] = {0, 1, 10, 999, n, n + 5};
+  for (usize t = 0; t < sizeof(ks) / sizeof(ks[0]); t++) {
+    arr(u64) top = arr_top_k(a, ks[t], u64_cmp);
+    STDR_ASSERT(arr_count(top) == (ks[t] < n ? ks[t] : n));
+    for (usize i = 0; i < arr_count(top); i++) {
+      STDR_ASSERT(top[i] == sorted[i]);
+    }
+    arr_free(top);
+  }
+  arr(u64) none = arr_top_k((arr(u64))NULL, 3, u64_cmp);
+  STDR_ASSERT(arr_count(none) == 0);
+  arr_free(none);
+
+  arr(big_t) big = NULL;
+  for (usize i = 0; i < 1000; i++) {
+    big_t b = {.key = a[i]};
+    memset(b.pad, (int)(a[i] & 0xFF), sizeof(b.pad));
+    arr_append(big, b);
+  }
+  arr(big_t) top = arr_top_k(big, 50, big_cmp);
+  arr_sort(big, big_cmp);
+  for (usize i = 0; i < 50; i++) {
+    STDR_ASSERT(top[i].key == big[i].key);
+    STDR_ASSERT(top[i].pad[99] == (u8)(big[i].key & 0xFF));
+  }
+  arr_free(top);
+  arr_free(big);
+  arr_free(sorted);
+  arr_free(a);
+
+  // Same counts as a full collect and sort
+  dstr_t content = read_file("data/pride_and_prejudice.txt");
+  arr(str_t) words = str_split_words(str(content));
+  map(i64) dic = NULL;
+  for (usize i = 0; i < arr_count(words); i++) map_increment(dic, words[i], 1);
+  arr(pair_t) all = NULL;
+  map_items_collect(dic, all);
+  arr_sort(all, pair_cmp);
+  arr(pair_t) best = NULL;
+  map_top_k(dic, best, 25, pair_cmp);
+  STDR_ASSERT(arr_count(best) == 25 && arr_capacity(best) <= 32);
+  for (usize i = 0; i < 25; i++) {
+    STDR_ASSERT(best[i].value == all[i].value);
+    STDR_ASSERT(*map_get(dic, best[i].key) == best[i].value);
+  }
+  printf("top_k first=%.*s %lld\n", SFMT(best[0].key),
+         (long long)best[0].value);
+  arr_free(best);
+  arr_free(all);
+  map_free(dic);
+  arr_free(words);
+  dstr_free(content);
+}
+
+#define TOKEN_FIELDS(X) X(str_t, word) X(u64, hash) X(i64, freq)
+STDR_SOA_DEFINE(tokens, TOKEN_FIELDS)
+
+void test_soa(void) {
+  dstr_t content = read_file("data/pride_and_prejudice.txt");
+  arr(str_t) words = str_split_words(str(content));
+
+  tokens_t t = {0};
+  map(usize) index = NULL;
+  for (usize i = 0; i < arr_count(words); i++) {
+    usize* row = map_get(index, words[i]);
+    if (row != NULL) {
+      t.freq[*row] += 1;
+      continue;
+    }
+    map_insert(index, words[i], t.count);
+    tokens_append(&t, words[i], stdr_hash(words[i], 0), 1);
+  }
+  STDR_ASSERT(t.count == map_count(index) && t.capacity >= t.count);
+
+  // Column scans
+  i64 total = 0;
+  u64 hashes = 0;
+  for (usize i = 0; i < t.count; i++) total += t.freq[i];
+  for (usize i = 0; i < t.count; i++) hashes ^= t.hash[i];
+  STDR_ASSERT(total == (i64)arr_count(words));
+  u64 expected = 0;
+  for (usize i = 0; i < t.count; i++) {
+    STDR_ASSERT(*map_get(index, t.word[i]) == i);
+    expected ^= stdr_hash(t.word[i], 0);
+  }
+  STDR_ASSERT(hashes == expected);
+
+  usize i = tokens_push(&t);
+  STDR_ASSERT(i == t.count - 1 && t.freq[i] == 0 && t.word[i].len == 0);
+  tokens_clear(&t);
+  STDR_ASSERT(t.count == 0 && t.capacity > 0);
+
+  // Columns keep the allocator of the first growth
+  stdr_arena_t arena;
+  stdr_arena_init(&arena, 0, NULL);
+  stdr_allocator_t* prev = stdr_allocator_set(&arena.allocator);
+  tokens_t small = {0};
+  tokens_reserve(&small, 4);
+  stdr_allocator_set(prev);
+  for (usize j = 0; j < 100; j++) tokens_append(&small, words[j], j, (i64)j);
+  STDR_ASSERT(small.allocator == &arena.allocator && small.freq[99] == 99);
+  tokens_free(&small);
+  stdr_arena_free(&arena);
+
+  printf("soa rows=%zu\n", map_count(index));
+  tokens_free(&t);
+  map_free(index);
+  arr_free(words);
+  dstr_free(content);
+}
+
+int main(void) {
+  test_grow();
+  test_bulk();
+  test_top_k();
+  test_soa();
+  return 0;
+}
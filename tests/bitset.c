@@ -0,0 +1,132 @@
+// clock_gettime is only declared with _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <time.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+#define STDR_BITSET_IMPLEMENTATION
+#include "stdr_bitset.h"
+
+double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+// Random bits with density about 1 / every, checked against arr(bool)
+void fill(bitset_t* b, arr(bool) * flags, usize count, u64 seed, u64 every) {
+  bitset_init(b, count);
+  *flags = NULL;
+  arr_resize(*flags, count);
+  for (usize i = 0; i < count; i++) {
+    if (stdr_hash_u64(i, seed) % every != 0) continue;
+    bitset_set(b, i);
+    (*flags)[i] = true;
+  }
+}
+
+void test_ops(usize count) {
+  bitset_t a, b, d;
+  arr(bool) fa;
+  arr(bool) fb;
+  fill(&a, &fa, count, 1, 2);
+  fill(&b, &fb, count, 2, 3);
+  bitset_init(&d, count);
+
+  usize expected = 0;
+  for (usize i = 0; i < count; i++) expected += fa[i];
+  STDR_ASSERT(bitset_popcount(&a) == expected);
+
+  bitset_and(&d, &a, &b);
+  for (usize i = 0; i < count; i++) {
+    STDR_ASSERT(bitset_test(&d, i) == (fa[i] && fb[i]));
+  }
+  bitset_or(&d, &a, &b);
+  for (usize i = 0; i < count; i++) {
+    STDR_ASSERT(bitset_test(&d, i) == (fa[i] || fb[i]));
+  }
+  bitset_xor(&d, &a, &b);
+  for (usize i = 0; i < count; i++) {
+    STDR_ASSERT(bitset_test(&d, i) == (fa[i] != fb[i]));
+  }
+  bitset_andnot(&d, &a, &b);
+  for (usize i = 0; i < count; i++) {
+    STDR_ASSERT(bitset_test(&d, i) == (fa[i] && !fb[i]));
+  }
+
+  // In place
+  bitset_and(&a, &a, &b);
+  for (usize i = 0; i < count; i++) {
+    STDR_ASSERT(bitset_test(&a, i) == (fa[i] && fb[i]));
+  }
+
+  // Rank and select are inverse on set bits
+  bitset_build_rank(&b);
+  usize rank = 0;
+  for (usize i = 0; i < count; i++) {
+    STDR_ASSERT(bitset_rank(&b, i) == rank);
+    if (fb[i]) {
+      STDR_ASSERT(bitset_select(&b, rank) == i);
+      rank += 1;
+    }
+  }
+  STDR_ASSERT(bitset_rank(&b, count) == rank && rank == bitset_popcount(&b));
+  STDR_ASSERT(bitset_select(&b, rank) == (usize)-1);
+
+  if (count > 0) {
+    bitset_clear(&b, count - 1);
+    STDR_ASSERT(!bitset_test(&b, count - 1));
+    bitset_set(&b, count - 1);
+    STDR_ASSERT(bitset_test(&b, count - 1));
+  }
+  bitset_clear_all(&b);
+  STDR_ASSERT(bitset_popcount(&b) == 0);
+
+  arr_free(fa);
+  arr_free(fb);
+  bitset_free(&a);
+  bitset_free(&b);
+  bitset_free(&d);
+}
+
+void bench(void) {
+  usize count = 1000000;
+  bitset_t a, b, d;
+  arr(bool) fa;
+  arr(bool) fb;
+  fill(&a, &fa, count, 3, 2);
+  fill(&b, &fb, count, 4, 2);
+  bitset_init(&d, count);
+
+  usize rounds = 1000;
+  double start = now();
+  for (usize r = 0; r < rounds; r++) bitset_and(&d, &a, &b);
+  double and_time = now() - start;
+
+  usize total = 0;
+  start = now();
+  for (usize r = 0; r < rounds; r++) {
+    bitset_and(&d, &a, &b);
+    total += bitset_popcount(&d);
+  }
+  double elapsed = now() - start;
+  STDR_ASSERT(total == rounds * bitset_popcount(&d));
+  printf("bitset %zu bits: and %.2f us, and+popcount %.2f us\n", count,
+         and_time * 1e6 / (double)rounds, elapsed * 1e6 / (double)rounds);
+
+  arr_free(fa);
+  arr_free(fb);
+  bitset_free(&a);
+  bitset_free(&b);
+  bitset_free(&d);
+}
+
+int main(void) {
+  usize counts[] = {0, 1, 63, 64, 65, 511, 512, 513, 1000, 4096, 100003};
+  for (usize i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    test_ops(counts[i]);
+  }
+  bench();
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Counts live blocks, so everything the cmap allocates has to go through
+// STDR_MALLOC and come back through STDR_FREE
+static _Atomic long live_blocks;
+
+void* counting_malloc(size_t size) {
+  atomic_fetch_add(&live_blocks, 1);
+  return malloc(size);
+}
+
+void counting_free(void* p) {
+  if (p != NULL) atomic_fetch_sub(&live_blocks, 1);
+  free(p);
+}
+
+#define STDR_MALLOC counting_malloc
+#define STDR_FREE counting_free
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+#define STDR_CMAP_IMPLEMENTATION
+#include "stdr_cmap.h"
+
+#define THREADS 8
+
+typedef struct {
+  str_t key;
+  i64 value;
+} pair_t;
+
+typedef struct {
+  arr(str_t) words;
+  usize begin;
+  usize end;
+  cmap(i64) dic;
+} job_t;
+
+void* count_words(void* arg) {
+  job_t* job = arg;
+  for (usize i = job->begin; i < job->end; i++) {
+    cmap_increment(job->dic, job->words[i], 1);
+  }
+  return NULL;
+}
+
+typedef struct {
+  usize thread;
+  cmap(i64) dic;
+} insert_job_t;
+
+#define INSERTS 20000
+
+void* insert_keys(void* arg) {
+  insert_job_t* job = arg;
+  char buf[32];
+  for (usize i = job->thread; i < INSERTS; i += THREADS) {
+    int len = snprintf(buf, sizeof(buf), "key-%zu", i);
+    cmap_insert(job->dic, ((str_t){buf, (usize)len}), (i64)i * 3);
+  }
+  return NULL;
+}
+
+void test_insert(void) {
+  long before = live_blocks;
+  map(i64) shard = NULL;
+  map_init(shard, 0, 0);
+  long per_map = live_blocks - before;
+  map_free(shard);
+
+  // One block for the header and shards, the rest are the shard maps
+  cmap(i64) dic = NULL;
+  cmap_init(dic, 16);
+  STDR_ASSERT(live_blocks - before == 1 + 16 * per_map);
+  STDR_ASSERT(cmap_shard_count(dic) == 16);
+  STDR_ASSERT((uintptr_t)cmap_header(dic)->shards % 64 == 0);
+
+  pthread_t threads[THREADS];
+  insert_job_t jobs[THREADS];
+  for (usize i = 0; i < THREADS; i++) {
+    jobs[i] = (insert_job_t){i, dic};
+    pthread_create(&threads[i], NULL, insert_keys, &jobs[i]);
+  }
+  for (usize i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+
+  STDR_ASSERT(cmap_count(dic) == INSERTS);
+  char buf[32];
+  for (usize i = 0; i < INSERTS; i++) {
+    int len = snprintf(buf, sizeof(buf), "key-%zu", i);
+    i64 value = -1;
+    STDR_ASSERT(cmap_get(dic, ((str_t){buf, (usize)len}), &value));
+    STDR_ASSERT(value == (i64)i * 3);
+  }
+  i64 value = 0;
+  STDR_ASSERT(!cmap_get(dic, str("key-missing"), &value));
+
+  // Overwrites keep the count
+  cmap_insert(dic, str("key-7"), -7);
+  STDR_ASSERT(cmap_get(dic, str("key-7"), &value) && value == -7);
+  STDR_ASSERT(cmap_count(dic) == INSERTS);
+  cmap_free(dic);
+}
+
+int main(void) {
+  dstr_t content = read_file("data/pride_and_prejudice.txt");
+  arr(str_t) words = str_split_words(str(content));
+  for (usize i = 0; i < arr_count(words); i++) str_to_lowercase(words[i]);
+
+  cmap(i64) dic = NULL;
+  cmap_init(dic, 0);
+
+  pthread_t threads[THREADS];
+  job_t jobs[THREADS];
+  usize n = arr_count(words);
+  for (usize i = 0; i < THREADS; i++) {
+    jobs[i] = (job_t){words, n * i / THREADS, n * (i + 1) / THREADS, dic};
+    pthread_create(&threads[i], NULL, count_words, &jobs[i]);
+  }
+  for (usize i = 0; i < THREADS; i++) pthread_join(threads[i], NULL);
+
+  map(i64) expected = NULL;
+  for (usize i = 0; i < n; i++) map_increment(expected, words[i], 1);
+
+  STDR_ASSERT(cmap_count(dic) == map_count(expected));
+  for (usize i = 0; i < n; i++) {
+    i64 count = 0;
+    STDR_ASSERT(cmap_get(dic, words[i], &count));
+    STDR_ASSERT(count == *map_get(expected, words[i]));
+  }
+
+  arr(pair_t) acc = NULL;
+  cmap_items_collect(dic, acc);
+  STDR_ASSERT(arr_count(acc) == map_count(expected));
+
+  i64 the = 0;
+  cmap_get(dic, str("the"), &the);
+  printf("%zu threads, %zu words, %zu unique, 'the' = %lld\n", (usize)THREADS,
+         n, cmap_count(dic), (long long)the);
+
+  arr_free(acc);
+  map_free(expected);
+  cmap_free(dic);
+  arr_free(words);
+  dstr_free(content);
+
+  test_insert();
+  STDR_ASSERT(live_blocks == 0);
+  return 0;
+}
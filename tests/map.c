@@ -0,0 +1,237 @@
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+
+#include "../src/words.h"
+
+#define word(i) str((char*)words[i])
+
+// Scratch copy of a word, overwritten after every insert
+str_t scratch(usize i) {
+  static char buf[64];
+  return str_cpy(word(i), buf);
+}
+
+void test_map(u32 flags) {
+  map(i64) m = NULL;
+  map_init(m, 0, flags);
+
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    str_t k = flags & MAP_OWN_KEYS ? scratch(i) : word(i);
+    map_insert(m, k, (i64)i);
+  }
+  STDR_ASSERT(map_count(m) == WORDS_COUNT);
+
+  // Compact maps keep insertion order
+  if (flags & MAP_COMPACT) {
+    STDR_ASSERT(map_end(m) == WORDS_COUNT);
+    for (usize i = 0; i < map_end(m); i++) {
+      STDR_ASSERT(m[i] == (i64)i && str_eq(map_key(m, i), word(i)));
+    }
+  }
+
+  // Drop every other word
+  for (usize i = 0; i < WORDS_COUNT; i += 2) {
+    STDR_ASSERT(map_remove(m, word(i)));
+  }
+  STDR_ASSERT(!map_remove(m, word(0)));
+  STDR_ASSERT(!map_remove(m, str("not a word")));
+
+  usize capacity = map_capacity(m);
+  map_shrink(m);
+  STDR_ASSERT(map_capacity(m) < capacity);
+
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    i64* v = map_get(m, word(i));
+    if (i % 2 == 0) {
+      STDR_ASSERT(v == NULL);
+    } else {
+      STDR_ASSERT(v != NULL && *v == (i64)i);
+    }
+  }
+
+  // Removed keys start from zero again
+  for (usize i = 0; i < WORDS_COUNT; i++) map_increment(m, word(i), 1);
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    STDR_ASSERT(*map_get(m, word(i)) == (i % 2 == 0 ? 1 : (i64)i + 1));
+  }
+  STDR_ASSERT(map_count(m) == WORDS_COUNT);
+
+  printf("flags=%u count=%zu capacity=%zu\n", flags, map_count(m),
+         map_capacity(m));
+  map_free(m);
+}
+
+// 17 to 64 bytes, all past MAP_KEY_INLINE
+str_t long_key(usize i, char* buf) {
+  usize len = MAP_KEY_INLINE + 1 + i % 48;
+  memset(buf, '-', (size_t)len);
+  snprintf(buf, 17, "long key %07zu", i);
+  buf[16] = '-';
+  return (str_t){buf, len};
+}
+
+typedef struct {
+  str_t key;
+  i64 value;
+} pair_t;
+
+void test_long_keys(u32 flags) {
+  usize n = 5000;
+  static char buf[64];
+  static char lookup[64];
+  // Without MAP_OWN_KEYS the caller keeps the keys alive
+  arr(str_t) owned = NULL;
+
+  map(i64) m = NULL;
+  map_init(m, 0, flags);
+  for (usize i = 0; i < n; i++) {
+    str_t k = long_key(i, buf);
+    if (!(flags & MAP_OWN_KEYS)) {
+      k = str_cpy_alloc(k);
+      arr_append(owned, k);
+    }
+    map_insert(m, k, (i64)i);
+    memset(buf, 'x', sizeof(buf));
+  }
+  STDR_ASSERT(map_count(m) == n);
+  for (usize i = 0; i < n; i++) {
+    i64* v = map_get(m, long_key(i, lookup));
+    STDR_ASSERT(v != NULL && *v == (i64)i);
+  }
+
+  for (usize i = 0; i < n; i += 2) {
+    STDR_ASSERT(map_remove(m, long_key(i, lookup)));
+  }
+  usize capacity = map_capacity(m);
+  map_shrink(m);
+  STDR_ASSERT(map_capacity(m) < capacity && map_count(m) == n / 2);
+  for (usize i = 0; i < n; i++) {
+    i64* v = map_get(m, long_key(i, lookup));
+    STDR_ASSERT(i % 2 == 0 ? v == NULL : v != NULL && *v == (i64)i);
+  }
+
+  // Keys stay readable through collected pairs and after more growth
+  arr(pair_t) pairs = NULL;
+  map_items_collect(m, pairs);
+  STDR_ASSERT(arr_count(pairs) == n / 2);
+  for (usize i = 0; i < arr_count(pairs); i++) {
+    usize index = (usize)pairs[i].value;
+    STDR_ASSERT(str_eq(pairs[i].key, long_key(index, lookup)));
+  }
+  arr_free(pairs);
+  for (usize i = 0; i < n; i += 2) {
+    str_t k = long_key(i, buf);
+    if (!(flags & MAP_OWN_KEYS)) k = owned[i];
+    map_insert(m, k, -(i64)i);
+    memset(buf, 'x', sizeof(buf));
+  }
+  for (usize i = 0; i < n; i++) {
+    i64* v = map_get(m, long_key(i, lookup));
+    STDR_ASSERT(v != NULL && *v == (i % 2 == 0 ? -(i64)i : (i64)i));
+  }
+
+  printf("long keys flags=%u count=%zu\n", flags, map_count(m));
+  map_free(m);
+  for (usize i = 0; i < arr_count(owned); i++) str_free(owned[i]);
+  arr_free(owned);
+}
+
+// Collected pairs with short keys point into the entries, so they are read
+// before the map changes and collected again after
+void test_collect_lifetime(u32 flags) {
+  map(i64) m = NULL;
+  map_init(m, 0, flags);
+  for (usize i = 0; i < 100; i++) map_insert(m, scratch(i), (i64)i);
+
+  arr(pair_t) pairs = NULL;
+  map_items_collect(m, pairs);
+  STDR_ASSERT(arr_count(pairs) == map_count(m));
+  const u8* begin = (const u8*)map_entries(m);
+  const u8* end = (const u8*)&map_entries(m)[map_end(m)];
+  for (usize i = 0; i < arr_count(pairs); i++) {
+    const u8* key = (const u8*)pairs[i].key.ptr;
+    if (pairs[i].key.len <= MAP_KEY_INLINE) {
+      STDR_ASSERT(key >= begin && key < end);
+    }
+    STDR_ASSERT(*map_get(m, pairs[i].key) == pairs[i].value);
+  }
+  arr_free(pairs);
+  pairs = NULL;
+
+  // Growth moves the entries, the old pairs would point at freed memory
+  for (usize i = 100; i < WORDS_COUNT; i++) map_insert(m, scratch(i), (i64)i);
+  map_items_collect(m, pairs);
+  STDR_ASSERT(arr_count(pairs) == map_count(m));
+  for (usize i = 0; i < arr_count(pairs); i++) {
+    STDR_ASSERT(*map_get(m, pairs[i].key) == pairs[i].value);
+  }
+  arr_free(pairs);
+  map_free(m);
+}
+
+void test_bulk(void) {
+  static str_t keys[WORDS_COUNT];
+  static i64 values[WORDS_COUNT];
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    keys[i] = word(i);
+    values[i] = (i64)i;
+  }
+
+  map(i64) m = map_from_arrays(keys, values, WORDS_COUNT);
+  usize capacity = map_capacity(m);
+  STDR_ASSERT(capacity == map_capacity_for(WORDS_COUNT));
+  STDR_ASSERT(map_count(m) == WORDS_COUNT);
+
+  // Existing keys are overwritten without growing the map
+  for (usize i = 0; i < WORDS_COUNT; i++) values[i] = -(i64)i;
+  map_insert_arrays(m, keys, values, WORDS_COUNT);
+  STDR_ASSERT(map_capacity(m) == capacity);
+  STDR_ASSERT(map_count(m) == WORDS_COUNT);
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    STDR_ASSERT(*map_get(m, word(i)) == -(i64)i);
+  }
+
+  static i64* found[WORDS_COUNT + 1];
+  str_t lookups[WORDS_COUNT + 1];
+  for (usize i = 0; i < WORDS_COUNT; i++) lookups[i] = word(i);
+  lookups[WORDS_COUNT] = STR("not a word");
+  map_get_batch(m, lookups, WORDS_COUNT + 1, found);
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    STDR_ASSERT(found[i] == map_get(m, word(i)) && *found[i] == -(i64)i);
+  }
+  STDR_ASSERT(found[WORDS_COUNT] == NULL);
+
+  // Half new keys, the map grows through the normal insert path
+  map(i64) half = map_from_arrays(keys, values, WORDS_COUNT / 2);
+  map_insert_arrays(half, keys, values, WORDS_COUNT);
+  STDR_ASSERT(map_count(half) == WORDS_COUNT);
+  STDR_ASSERT(map_capacity(half) == map_capacity_for(WORDS_COUNT));
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    STDR_ASSERT(*map_get(half, word(i)) == -(i64)i);
+  }
+  map_free(half);
+
+  map_reserve(m, 4 * capacity);
+  STDR_ASSERT(map_capacity(m) > capacity && map_count(m) == WORDS_COUNT);
+
+  printf("bulk count=%zu capacity=%zu\n", map_count(m), map_capacity(m));
+  map_free(m);
+}
+
+int main(void) {
+  test_map(0);
+  test_map(MAP_INCREMENTAL);
+  test_map(MAP_COMPACT);
+  test_map(MAP_OWN_KEYS);
+  test_map(MAP_COMPACT | MAP_OWN_KEYS);
+  test_long_keys(0);
+  test_long_keys(MAP_OWN_KEYS);
+  test_long_keys(MAP_COMPACT | MAP_OWN_KEYS);
+  test_collect_lifetime(0);
+  test_collect_lifetime(MAP_INCREMENTAL);
+  test_collect_lifetime(MAP_COMPACT);
+  test_bulk();
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include <stddef.h>
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+#define STDR_MAPFILE_IMPLEMENTATION
+#include "stdr_mapfile.h"
+
+#include "../src/words.h"
+
+#define word(i) str((char*)words[i])
+
+#define PATH "mapfile.bin"
+
+void test_mapfile(u32 flags) {
+  map(i64) m = NULL;
+  map_init(m, 0, flags);
+  for (usize i = 0; i < WORDS_COUNT; i++) map_insert(m, word(i), (i64)i);
+  // Removed keys must not be written
+  for (usize i = 0; i < WORDS_COUNT; i += 3) map_remove(m, word(i));
+  // Longer than MAP_KEY_INLINE, stored outside the entry
+  str_t long_key = STR("a key that does not fit in the map entry");
+  map_insert(m, long_key, -1);
+
+  STDR_ASSERT(mapfile_save(m, PATH));
+  mapfile_t f;
+  STDR_ASSERT(mapfile_open(&f, PATH));
+  STDR_ASSERT(mapfile_count(&f) == map_count(m));
+  STDR_ASSERT(mapfile_item_size(&f) == sizeof(i64));
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    const i64* v = mapfile_get(&f, i64, word(i));
+    if (i % 3 == 0) {
+      STDR_ASSERT(v == NULL);
+    } else {
+      STDR_ASSERT(v != NULL && *v == (i64)i);
+    }
+  }
+  STDR_ASSERT(*mapfile_get(&f, i64, long_key) == -1);
+  STDR_ASSERT(mapfile_get(&f, i64, STR("not a word")) == NULL);
+
+  printf("flags=%u count=%zu size=%zu\n", flags, (usize)mapfile_count(&f),
+         f.size);
+  mapfile_close(&f);
+  map_free(m);
+}
+
+// Writes content with the width bytes of one header field replaced and
+// tries to open it
+bool open_patched(arr(char) content, usize offset, u64 value, usize width) {
+  u8 bytes[sizeof(u64)];
+  if (width == sizeof(u32)) {
+    u32 narrow = (u32)value;
+    memcpy(bytes, &narrow, sizeof(narrow));
+  } else {
+    memcpy(bytes, &value, sizeof(value));
+  }
+  FILE* file = fopen(PATH, "wb");
+  fwrite(content, 1, offset, file);
+  fwrite(bytes, 1, (size_t)width, file);
+  usize rest = offset + width;
+  fwrite(&content[rest], 1, (size_t)(arr_count(content) - 1 - rest), file);
+  fclose(file);
+
+  mapfile_t f;
+  bool ok = mapfile_open(&f, PATH);
+  if (ok) {
+    mapfile_get(&f, i64, STR("key"));
+    mapfile_close(&f);
+  }
+  return ok;
+}
+
+void test_invalid(void) {
+  mapfile_t f;
+  STDR_ASSERT(!mapfile_open(&f, "does/not/exist"));
+
+  map(i64) m = NULL;
+  map_insert(m, STR("key"), 1);
+  STDR_ASSERT(mapfile_save(m, PATH));
+  map_free(m);
+
+  arr(char) content = read_file(PATH);
+  STDR_ASSERT(open_patched(content, 0, *(u64*)content, sizeof(u64)));
+
+  // Offsets past the end, or whose sums with the section lengths wrap
+#define patch(field, value)                                                    \
+  STDR_ASSERT(!open_patched(content, offsetof(mapfile_header_t, field), value, \
+                            sizeof(((mapfile_header_t*)0)->field)))
+  patch(ctrl, (u64)-8);
+  patch(slots, (u64)-16);
+  patch(values, (u64)-16);
+  patch(keys, (u64)-1);
+  patch(ctrl, 0);
+  patch(values, 8);
+  patch(capacity, (u64)1 << 63);
+  patch(capacity, (u64)1 << 59);
+  patch(capacity, 24);
+  patch(count, (u64)1 << 62);
+  // Only the 4 byte item_size changes, capacity stays valid
+  patch(item_size, (u64)1 << 31 | 8);
+#undef patch
+  // Values not aligned for the item type
+  mapfile_header_t h;
+  memcpy(&h, content, sizeof(h));
+  STDR_ASSERT(!open_patched(content, offsetof(mapfile_header_t, values),
+                            h.values + 8, sizeof(h.values)));
+
+  // Truncated
+  FILE* file = fopen(PATH, "wb");
+  fwrite(content, 1, (size_t)(arr_count(content) - 2), file);
+  fclose(file);
+  STDR_ASSERT(!mapfile_open(&f, PATH));
+  arr_free(content);
+}
+
+int main(void) {
+  test_mapfile(0);
+  test_mapfile(MAP_COMPACT);
+  test_mapfile(MAP_INCREMENTAL | MAP_OWN_KEYS);
+  test_invalid();
+  remove(PATH);
+  return 0;
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+
+#include "../src/words.h"
+#include "../src/words_phf.h"
+
+#define word(i) str((char*)words[i])
+
+int main(void) {
+  STDR_ASSERT(words_phf.count == WORDS_COUNT);
+
+  // Every word has its own slot
+  static bool taken[WORDS_COUNT];
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    usize slot = phf_index(&words_phf, word(i));
+    STDR_ASSERT(slot < WORDS_COUNT && !taken[slot]);
+    STDR_ASSERT(strcmp(words_phf.keys[slot], words[i]) == 0);
+    taken[slot] = true;
+  }
+
+  STDR_ASSERT(!phf_has(&words_phf, STR("")));
+  STDR_ASSERT(!phf_has(&words_phf, STR("zymi")));
+  STDR_ASSERT(!phf_has(&words_phf, STR("zymics")));
+  STDR_ASSERT(!phf_has(&words_phf, STR("qqqqq")));
+  // A stored key followed by NUL and more bytes, read no further than the key
+  for (usize i = 0; i < WORDS_COUNT; i++) {
+    char buf[64];
+    usize len = strlen(words[i]);
+    memcpy(buf, words[i], len);
+    memcpy(&buf[len], "\0x", 2);
+    STDR_ASSERT(!phf_has(&words_phf, ((str_t){buf, len + 2})));
+  }
+
+  printf("count=%zu buckets=%zu\n", words_phf.count, words_phf.bucket_count);
+  return 0;
+}
@@ -0,0 +1,169 @@
+// clock_gettime is only declared with _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+#define STDR_RING_IMPLEMENTATION
+#include "stdr_ring.h"
+
+#define ITEMS 2000000
+
+typedef struct {
+  ring_t* ring;
+  bool batched;
+} producer_t;
+
+void* produce(void* arg) {
+  producer_t* p = arg;
+  u64 batch[64];
+  for (u64 i = 0; i < ITEMS;) {
+    if (!p->batched) {
+      if (ring_push(p->ring, &i)) {
+        i++;
+      } else {
+        sched_yield();
+      }
+      continue;
+    }
+    usize n = 0;
+    for (; n < 64 && i + n < ITEMS; n++) batch[n] = i + n;
+    usize pushed = 0;
+    while (pushed < n) {
+      usize k = ring_push_n(p->ring, &batch[pushed], n - pushed);
+      if (k == 0) sched_yield();
+      pushed += k;
+    }
+    i += n;
+  }
+  return NULL;
+}
+
+double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+void test_ring(bool batched) {
+  ring_t r;
+  ring_init(&r, sizeof(u64), 1000);
+  STDR_ASSERT(ring_capacity(&r) == 1024 && ring_count(&r) == 0);
+  u64 item = 0;
+  STDR_ASSERT(!ring_pop(&r, &item));
+
+  producer_t p = {&r, batched};
+  double start = now();
+  pthread_t thread;
+  pthread_create(&thread, NULL, produce, &p);
+  // Items arrive in order, each exactly once
+  u64 batch[100];
+  // Waiting sides yield, the producer may share a core with the consumer
+  for (u64 next = 0; next < ITEMS;) {
+    if (!batched) {
+      if (ring_pop(&r, &item)) {
+        STDR_ASSERT(item == next++);
+      } else {
+        sched_yield();
+      }
+      continue;
+    }
+    usize n = ring_pop_n(&r, batch, 100);
+    if (n == 0) sched_yield();
+    for (usize i = 0; i < n; i++) STDR_ASSERT(batch[i] == next++);
+  }
+  pthread_join(thread, NULL);
+  double elapsed = now() - start;
+  STDR_ASSERT(ring_count(&r) == 0 && !ring_pop(&r, &item));
+
+  // Full ring, then wrapped batches on one thread
+  for (u64 i = 0; i < 1024; i++) STDR_ASSERT(ring_push(&r, &i));
+  STDR_ASSERT(!ring_push(&r, &item) && ring_count(&r) == 1024);
+  STDR_ASSERT(ring_pop_n(&r, batch, 100) == 100 && batch[99] == 99);
+  u64 more[200];
+  for (u64 i = 0; i < 200; i++) more[i] = 1024 + i;
+  STDR_ASSERT(ring_push_n(&r, more, 200) == 100);
+  for (u64 i = 100; i < 1124; i++) {
+    STDR_ASSERT(ring_pop(&r, &item) && item == i);
+  }
+  STDR_ASSERT(ring_count(&r) == 0);
+
+  printf("ring batched=%d %.1f ns/item\n", batched,
+         elapsed * 1e9 / (double)ITEMS);
+  ring_free(&r);
+}
+
+void test_deque(void) {
+  deque(i64) d = NULL;
+  STDR_ASSERT(deque_count(d) == 0);
+  deque_push_back(d, 1);
+  deque_push_front(d, 0);
+  STDR_ASSERT(deque_front(d) == 0 && deque_back(d) == 1);
+  STDR_ASSERT(deque_pop_back(d) == 1 && deque_pop_front(d) == 0);
+  STDR_ASSERT(deque_count(d) == 0);
+
+  // Against an array, with the head moving around so growth has to unwrap
+  arr(i64) expected = NULL;
+  usize front = 0;
+  for (i64 i = 0; i < 100000; i++) {
+    u64 op = stdr_hash_u64((u64)i, 3) % 4;
+    if (op == 0 && deque_count(d) > 0) {
+      STDR_ASSERT(deque_pop_front(d) == expected[front++]);
+    } else if (op == 1 && deque_count(d) > 0) {
+      STDR_ASSERT(deque_pop_back(d) == arr_last(expected));
+      arr_header(expected)->count -= 1;
+    } else {
+      deque_push_back(d, i);
+      arr_append(expected, i);
+    }
+    STDR_ASSERT(deque_count(d) == arr_count(expected) - front);
+  }
+  for (usize i = 0; i < deque_count(d); i++) {
+    STDR_ASSERT(deque_at(d, i) == expected[front + i]);
+  }
+
+  usize count = deque_count(d);
+  for (i64 i = 1; i <= 1000; i++) deque_push_front(d, -i);
+  STDR_ASSERT(deque_count(d) == count + 1000 && deque_front(d) == -1000);
+  STDR_ASSERT(deque_at(d, 1000) == expected[front]);
+  STDR_ASSERT((deque_capacity(d) & (deque_capacity(d) - 1)) == 0);
+  deque_clear(d);
+  STDR_ASSERT(deque_count(d) == 0);
+
+  printf("deque capacity=%zu\n", deque_capacity(d));
+  arr_free(expected);
+  deque_free(d);
+}
+
+void test_ring_allocator(void) {
+  // Items come from the allocator that was current at ring_init
+  stdr_arena_t arena;
+  stdr_arena_init(&arena, 0, NULL);
+  stdr_allocator_t* prev = stdr_allocator_set(&arena.allocator);
+  ring_t r;
+  ring_init(&r, sizeof(u64), 16);
+  stdr_allocator_set(prev);
+  STDR_ASSERT(r.allocator == &arena.allocator);
+  for (u64 i = 0; i < 16; i++) STDR_ASSERT(ring_push(&r, &i));
+  u64 item = 0;
+  STDR_ASSERT(ring_pop(&r, &item) && item == 0);
+  ring_free(&r);
+  stdr_arena_free(&arena);
+
+  ring_t* heap = aligned_alloc(STDR_CACHE_LINE, sizeof(ring_t));
+  ring_init(heap, sizeof(u64), 4);
+  STDR_ASSERT(ring_push(heap, &item) && ring_count(heap) == 1);
+  ring_free(heap);
+  free(heap);
+}
+
+int main(void) {
+  test_ring(false);
+  test_ring(true);
+  test_deque();
+  test_ring_allocator();
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+#include "stdr_segarr.h"
+
+void test_index(void) {
+  // Block boundaries
+  STDR_ASSERT(segarr_block(0) == 0 && segarr_offset(0) == 0);
+  STDR_ASSERT(segarr_block(SEGARR_FIRST - 1) == 0);
+  STDR_ASSERT(segarr_block(SEGARR_FIRST) == 1);
+  STDR_ASSERT(segarr_offset(SEGARR_FIRST) == 0);
+  STDR_ASSERT(segarr_block(3 * SEGARR_FIRST - 1) == 1);
+  STDR_ASSERT(segarr_block(3 * SEGARR_FIRST) == 2);
+  STDR_ASSERT(segarr_block((usize)-1 - SEGARR_FIRST) == SEGARR_BLOCKS - 1);
+}
+
+void test_stable(void) {
+  segarr(u64) s = NULL;
+  STDR_ASSERT(segarr_count(s) == 0);
+  segarr_append(s, 7);
+  u64* first = segarr_at(s, 0);
+
+  usize n = 1000000;
+  for (usize i = 1; i < n; i++) segarr_append(s, i * i);
+  STDR_ASSERT(segarr_count(s) == n && segarr_last(s) == (n - 1) * (n - 1));
+  STDR_ASSERT(first == segarr_at(s, 0) && *first == 7);
+  for (usize i = 1; i < n; i++) STDR_ASSERT(*segarr_at(s, i) == i * i);
+
+  u64* mid = segarr_at(s, n / 2);
+  segarr_clear(s);
+  STDR_ASSERT(segarr_count(s) == 0);
+  for (usize i = 0; i < n; i++) segarr_append(s, i);
+  STDR_ASSERT(mid == segarr_at(s, n / 2) && *mid == n / 2);
+  segarr_free(s);
+}
+
+void test_words(void) {
+  dstr_t content = read_file("data/pride_and_prejudice.txt");
+  arr(str_t) words = str_split_words(str(content));
+
+  // Pointers into the log stay valid while it grows
+  segarr(str_t) log = NULL;
+  arr(str_t*) refs = NULL;
+  for (usize i = 0; i < arr_count(words); i++) {
+    segarr_append(log, words[i]);
+    if (i % 1000 == 0) arr_append(refs, &segarr_last(log));
+  }
+  STDR_ASSERT(segarr_count(log) == arr_count(words));
+  for (usize i = 0; i < arr_count(refs); i++) {
+    STDR_ASSERT(str_eq(*refs[i], words[i * 1000]));
+  }
+
+  // Blocks come from the arena that was set when the array was created
+  stdr_arena_t arena;
+  stdr_arena_init(&arena, 0, NULL);
+  stdr_allocator_t* prev = stdr_allocator_set(&arena.allocator);
+  segarr(str_t) copy = NULL;
+  segarr_append(copy, *segarr_at(log, 0));
+  stdr_allocator_set(prev);
+  for (usize i = 1; i < segarr_count(log); i++) {
+    segarr_append(copy, *segarr_at(log, i));
+  }
+  STDR_ASSERT(segarr_header(copy)->allocator == &arena.allocator);
+  STDR_ASSERT(str_eq(segarr_last(copy), arr_last(words)));
+  segarr_free(copy);
+  stdr_arena_free(&arena);
+
+  printf("segarr words=%zu\n", segarr_count(log));
+  segarr_free(log);
+  arr_free(refs);
+  arr_free(words);
+  dstr_free(content);
+}
+
+int main(void) {
+  test_index();
+  test_stable();
+  test_words();
+  return 0;
+}
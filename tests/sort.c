@@ -0,0 +1,141 @@
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+#define STDR_SORT_IMPLEMENTATION
+#include "stdr_sort.h"
+
+typedef struct {
+  str_t key;
+  i64 value;
+} pair_t;
+
+#define u64_less(a, b) ((a) < (b))
+STDR_SORT_DEFINE(u64s, u64, u64_less)
+STDR_RADIX_SORT_DEFINE(u64s_radix, u64, stdr_radix_i64)
+
+// Descending by value, ties by key length so the order is total
+#define pair_less(a, b)     \
+  ((a).value > (b).value || \
+   ((a).value == (b).value && (a).key.len < (b).key.len))
+STDR_SORT_DEFINE(pairs, pair_t, pair_less)
+#define pair_key(p) (~stdr_radix_i64((p).value))
+STDR_RADIX_SORT_DEFINE(pairs_radix, pair_t, pair_key)
+
+int u64_cmp(const void* a, const void* b) {
+  u64 x = *(const u64*)a;
+  u64 y = *(const u64*)b;
+  return (x > y) - (x < y);
+}
+
+u64 rng(u64* state) { return stdr_hash_u64((*state)++, 0x1234); }
+
+// Random, sorted, reversed, few distinct and organ pipe inputs
+void fill(u64* a, usize n, usize pattern, u64* state) {
+  for (usize i = 0; i < n; i++) {
+    switch (pattern) {
+      case 0: a[i] = rng(state); break;
+      case 1: a[i] = i; break;
+      case 2: a[i] = n - i; break;
+      case 3: a[i] = rng(state) % 4; break;
+      default: a[i] = i < n / 2 ? i : n - i; break;
+    }
+  }
+}
+
+void test_u64(void) {
+  static u64 a[100000], b[100000], c[100000], d[100000];
+  usize sizes[] = {0, 1, 2, 3, 16, 17, 100, 1000, 100000};
+  u64 state = 1;
+  for (usize s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    usize n = sizes[s];
+    for (usize pattern = 0; pattern < 5; pattern++) {
+      fill(a, n, pattern, &state);
+      // Signed order for the radix key, keep the values small enough
+      for (usize i = 0; i < n; i++) a[i] >>= 1;
+      memcpy(b, a, n * sizeof(u64));
+      memcpy(c, a, n * sizeof(u64));
+      memcpy(d, a, n * sizeof(u64));
+      qsort(a, n, sizeof(u64), u64_cmp);
+      u64s_sort(b, n);
+      u64s_radix_sort(c, n);
+      // No depth left, straight to heapsort
+      u64s_introsort(d, n, 0);
+      STDR_ASSERT(memcmp(a, b, n * sizeof(u64)) == 0);
+      STDR_ASSERT(memcmp(a, c, n * sizeof(u64)) == 0);
+      STDR_ASSERT(memcmp(a, d, n * sizeof(u64)) == 0);
+    }
+  }
+}
+
+void test_pairs(void) {
+  usize n = 50000;
+  arr(pair_t) a = NULL;
+  arr(pair_t) b = NULL;
+  u64 state = 7;
+  for (usize i = 0; i < n; i++) {
+    pair_t p = {{NULL, i % 7}, (i64)(rng(&state) % 1000) - 500};
+    arr_append(a, p);
+    arr_append(b, p);
+  }
+  pairs_sort(a, arr_count(a));
+  pairs_radix_sort(b, arr_count(b));
+  for (usize i = 1; i < n; i++) {
+    STDR_ASSERT(!pair_less(a[i], a[i - 1]));
+    STDR_ASSERT(b[i - 1].value >= b[i].value);
+    STDR_ASSERT(a[i].value == b[i].value);
+  }
+  printf("pairs n=%zu first=%lld last=%lld\n", n, (long long)a[0].value,
+         (long long)a[n - 1].value);
+  arr_free(a);
+  arr_free(b);
+}
+
+int pair_cmp(const void* a, const void* b) {
+  const pair_t* x = a;
+  const pair_t* y = b;
+  return (y->value > x->value) - (y->value < x->value);
+}
+
+// Stable, so it matches the radix sort exactly
+void test_parallel(void) {
+  usize sizes[] = {1000, STDR_SORT_PARALLEL_MIN, 300001};
+  usize threads[] = {0, 2, 3, 7};
+  u64 state = 3;
+  for (usize s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    usize n = sizes[s];
+    pair_t* a = malloc(n * sizeof(pair_t));
+    pair_t* b = malloc(n * sizeof(pair_t));
+    for (usize t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+      for (usize i = 0; i < n; i++) {
+        a[i] = (pair_t){{NULL, i}, (i64)(rng(&state) % 5000)};
+      }
+      memcpy(b, a, n * sizeof(pair_t));
+      stdr_sort_parallel(a, n, sizeof(pair_t), pair_cmp, threads[t]);
+      pairs_radix_sort(b, n);
+      for (usize i = 0; i < n; i++) {
+        STDR_ASSERT(a[i].value == b[i].value);
+        STDR_ASSERT(a[i].key.len == b[i].key.len);
+      }
+    }
+    free(a);
+    free(b);
+  }
+
+  arr(pair_t) acc = NULL;
+  for (usize i = 0; i < 100000; i++) {
+    arr_append(acc, (pair_t){{NULL, 0}, (i64)(rng(&state) % 100)});
+  }
+  arr_sort_parallel(acc, pair_cmp);
+  for (usize i = 1; i < arr_count(acc); i++) {
+    STDR_ASSERT(acc[i - 1].value >= acc[i].value);
+  }
+  arr_free(acc);
+}
+
+int main(void) {
+  test_u64();
+  test_pairs();
+  test_parallel();
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+#include "stdr_tmap.h"
+
+STDR_TMAP_DEFINE(ids, u64, i64, stdr_hash_int, stdr_eq_int)
+
+typedef struct {
+  i32 x;
+  i32 y;
+} point_t;
+
+#define point_hash(p, seed) \
+  stdr_hash_u64((u64)(u32)(p).x << 32 | (u32)(p).y, seed)
+#define point_eq(a, b) ((a).x == (b).x && (a).y == (b).y)
+
+STDR_TMAP_DEFINE(grid, point_t, u8, point_hash, point_eq)
+
+#define N 100000
+
+int main(void) {
+  ids_t ids = {0};
+  for (u64 i = 0; i < N; i++) ids_insert(&ids, i * 2654435761u, (i64)i);
+  STDR_ASSERT(ids.count == N);
+
+  for (u64 i = 0; i < N; i += 3) STDR_ASSERT(ids_remove(&ids, i * 2654435761u));
+  for (u64 i = 0; i < N; i++) {
+    i64* v = ids_get(&ids, i * 2654435761u);
+    STDR_ASSERT(i % 3 == 0 ? v == NULL : *v == (i64)i);
+  }
+  for (u64 i = 0; i < N; i++) *ids_get_or_insert(&ids, i * 2654435761u) += 1;
+  STDR_ASSERT(ids.count == N);
+
+  i64 sum = 0;
+  for (usize i = 0; i < ids.capacity; i++) {
+    if (tmap_live(&ids, i)) sum += ids.items[i].value;
+  }
+  printf("ids count=%zu capacity=%zu sum=%lld\n", ids.count, ids.capacity,
+         (long long)sum);
+  ids_free(&ids);
+
+  grid_t grid = {0};
+  grid_reserve(&grid, 64 * 64);
+  usize capacity = grid.capacity;
+  for (i32 x = -32; x < 32; x++) {
+    for (i32 y = -32; y < 32; y++) grid_insert(&grid, (point_t){x, y}, 1);
+  }
+  STDR_ASSERT(grid.capacity == capacity && grid.count == 64 * 64);
+  STDR_ASSERT(grid_get(&grid, (point_t){-32, 31}) != NULL);
+  STDR_ASSERT(grid_get(&grid, (point_t){32, 0}) == NULL);
+  printf("grid count=%zu capacity=%zu\n", grid.count, grid.capacity);
+  grid_free(&grid);
+
+  // Tables keep the allocator of their first growth
+  stdr_arena_t arena;
+  stdr_arena_init(&arena, 0, NULL);
+  stdr_allocator_t* prev = stdr_allocator_set(&arena.allocator);
+  ids_t scoped = {0};
+  ids_insert(&scoped, 1, 1);
+  stdr_allocator_set(prev);
+  for (u64 i = 0; i < 1000; i++) ids_insert(&scoped, i, (i64)i);
+  STDR_ASSERT(scoped.allocator == &arena.allocator && scoped.count == 1000);
+  STDR_ASSERT(*ids_get(&scoped, 999) == 999);
+  ids_free(&scoped);
+  stdr_arena_free(&arena);
+
+  return 0;
+}
@@ -0,0 +1,290 @@
+#include <stdio.h>
+
+#define STDR_IMPLEMENTATION
+#include "stdr.h"
+#include "stdr_flag.h"
+#include "stdr_phf.h"
+
+// Generates a stdr_phf.h table for a fixed key set:
+//
+//   ./phf_gen -in src/words.h -out words_phf.h -name words
+//
+// Keys are the string literals of the input if it has any, so C tables like
+// src/words.h can be used as they are. Otherwise every whitespace separated
+// word is a key.
+
+// Displacements tried per bucket before the seed is changed
+#define PHF_MAX_DISP (1u << 20)
+#define PHF_MAX_SEEDS 64
+
+static bool parse_literal(str_t* s, dstr_t* key) {
+  *key = NULL;
+  for (usize i = 1; i < s->len; i++) {
+    char ch = s->ptr[i];
+    if (ch == '"') {
+      *s = str_drop(*s, i + 1);
+      return true;
+    }
+    if (ch == '\\' && i + 1 < s->len) {
+      i++;
+      switch (s->ptr[i]) {
+        case 'n': ch = '\n'; break;
+        case 't': ch = '\t'; break;
+        case '"': ch = '"'; break;
+        case '\\': ch = '\\'; break;
+        default: return false;
+      }
+    }
+    dstr_append(key, ch);
+  }
+  return false;
+}
+
+static arr(str_t) read_keys(str_t s) {
+  arr(str_t) keys = NULL;
+  if (memchr(s.ptr, '"', (size_t)s.len) == NULL) {
+    arr(str_t) words = str_split_words(str_trim_start(s));
+    for (usize i = 0; i < arr_count(words); i++) {
+      arr_append(keys, str_cpy_alloc(words[i]));
+    }
+    arr_free(words);
+    return keys;
+  }
+
+  while (s.len > 0) {
+    if (s.ptr[0] != '"') {
+      s = str_drop(s, 1);
+      continue;
+    }
+    dstr_t key;
+    if (!parse_literal(&s, &key)) {
+      fprintf(stderr, "[ERROR] Unterminated or unsupported string literal\n");
+      exit(1);
+    }
+    str_t k = str_alloc(arr_count(key));
+    if (key != NULL) memcpy(k.ptr, key, (size_t)k.len);
+    arr_append(keys, k);
+    dstr_free(key);
+  }
+  return keys;
+}
+
+// Places the buckets largest first, each at the first displacement that
+// moves all of its keys to free slots. Fails if one cannot be placed.
+static bool build(const arr(str_t) keys, u64 seed, usize bucket_count,
+                  u32* disp, usize* slots) {
+  usize n = arr_count(keys);
+  u64* hashes = malloc((size_t)n * sizeof(*hashes));
+  usize* starts = calloc((size_t)bucket_count + 1, sizeof(*starts));
+  usize* members = malloc((size_t)n * sizeof(*members));
+  usize* cursor = malloc((size_t)bucket_count * sizeof(*cursor));
+  usize* placed = malloc((size_t)n * sizeof(*placed));
+
+  // Counting sort of the keys by bucket, bucket b is
+  // members[starts[b] .. starts[b + 1]]
+  for (usize i = 0; i < n; i++) {
+    hashes[i] = stdr_hash(keys[i], seed);
+    starts[phf_bucket(hashes[i], bucket_count) + 1] += 1;
+  }
+  usize max_size = 0;
+  for (usize b = 0; b < bucket_count; b++) {
+    if (starts[b + 1] > max_size) max_size = starts[b + 1];
+    starts[b + 1] += starts[b];
+    cursor[b] = starts[b];
+  }
+  for (usize i = 0; i < n; i++) {
+    members[cursor[phf_bucket(hashes[i], bucket_count)]++] = i;
+  }
+
+  for (usize i = 0; i < n; i++) slots[i] = (usize)-1;
+  memset(disp, 0, (size_t)bucket_count * sizeof(*disp));
+
+  bool ok = true;
+  for (usize size = max_size; size > 0 && ok; size--) {
+    for (usize b = 0; b < bucket_count && ok; b++) {
+      if (starts[b + 1] - starts[b] != size) continue;
+      ok = false;
+      for (u32 d = 0; d < PHF_MAX_DISP && !ok; d++) {
+        usize count = 0;
+        for (; count < size; count++) {
+          usize key = members[starts[b] + count];
+          usize slot = phf_slot(hashes[key], d, n);
+          if (slots[slot] != (usize)-1) break;
+          slots[slot] = key;
+          placed[count] = slot;
+        }
+        ok = count == size;
+        if (ok) {
+          disp[b] = d;
+        } else {
+          for (usize i = 0; i < count; i++) slots[placed[i]] = (usize)-1;
+        }
+      }
+    }
+  }
+
+  free(hashes);
+  free(starts);
+  free(cursor);
+  free(members);
+  free(placed);
+  return ok;
+}
+
+static dstr_t escape(str_t k) {
+  dstr_t item = NULL;
+  dstr_append(&item, '"');
+  for (usize i = 0; i < k.len; i++) {
+    char ch = k.ptr[i];
+    if (ch == '"' || ch == '\\') {
+      dstr_append(&item, '\\');
+    } else if (ch == '\n' || ch == '\t') {
+      dstr_append(&item, '\\');
+      ch = ch == '\n' ? 'n' : 't';
+    } else if (ch == '\0') {
+      // Three digits, so a digit after it is not part of the escape
+      dstr_append(&item, '\\');
+      dstr_append(&item, '0');
+      dstr_append(&item, '0');
+      ch = '0';
+    }
+    dstr_append(&item, ch);
+  }
+  dstr_append(&item, '"');
+  return item;
+}
+
+// Four space indented initializer items, wrapped at 80 columns
+static void emit_item(FILE* f, usize* column, str_t item) {
+  if (*column != 0 && *column + item.len + 2 > 80) {
+    fprintf(f, "\n");
+    *column = 0;
+  }
+  if (*column == 0) {
+    fprintf(f, "    ");
+    *column = 4;
+  } else {
+    fprintf(f, " ");
+    *column += 1;
+  }
+  fprintf(f, "%.*s,", SFMT(item));
+  *column += item.len + 1;
+}
+
+i32 main(i32 argc, const cstr_t argv[]) {
+  str_t in = STR_NULL;
+  str_t out = STR_NULL;
+  str_t name = STR("phf");
+  stdr_flag_str(&in, str("in"),
+                str("Key list, or C source whose string literals are keys"));
+  stdr_flag_str(&out, str("out"), str("Generated header, stdout if not set"));
+  stdr_flag_str(&name, str("name"), str("Prefix of the generated tables"));
+  stdr_flag_parse(argc, argv);
+
+  FILE* input = str_is_null(in) ? NULL : fopen(in.ptr, "r");
+  if (input == NULL) {
+    fprintf(stderr, "[ERROR] Cannot read -in '%.*s'\n", SFMT(in));
+    return 1;
+  }
+  fclose(input);
+  arr(char) content = read_file(in.ptr);
+  if (arr_count(content) <= 1) {
+    fprintf(stderr, "[ERROR] -in '%.*s' is empty\n", SFMT(in));
+    return 1;
+  }
+  arr(str_t) keys = read_keys((str_t){content, arr_count(content) - 1});
+  usize n = arr_count(keys);
+  if (n == 0 || n > UINT32_MAX) {
+    fprintf(stderr, "[ERROR] Expected 1 to 2^32 - 1 keys, got %zu\n", n);
+    return 1;
+  }
+  for (usize i = 0; i < n; i++) {
+    if (keys[i].len > UINT32_MAX) {
+      fprintf(stderr, "[ERROR] Key %zu is longer than 2^32 - 1 bytes\n", i);
+      return 1;
+    }
+  }
+
+  map(u8) seen = NULL;
+  for (usize i = 0; i < n; i++) {
+    if (map_has(seen, keys[i])) {
+      fprintf(stderr, "[ERROR] Duplicate key '%.*s'\n", SFMT(keys[i]));
+      return 1;
+    }
+    map_insert(seen, keys[i], 1);
+  }
+  map_free(seen);
+
+  usize bucket_count = (n + PHF_BUCKET_SIZE - 1) / PHF_BUCKET_SIZE;
+  u32* disp = malloc((size_t)bucket_count * sizeof(*disp));
+  usize* slots = malloc((size_t)n * sizeof(*slots));
+  // Seeds are fixed so the output only depends on the keys
+  u64 seed = 0;
+  bool ok = false;
+  for (u64 attempt = 0; attempt < PHF_MAX_SEEDS && !ok; attempt++) {
+    seed = stdr_hash_u64(attempt, 0x5048465f47454e31ull);
+    ok = build(keys, seed, bucket_count, disp, slots);
+  }
+  if (!ok) {
+    fprintf(stderr, "[ERROR] No perfect hash found\n");
+    return 1;
+  }
+
+  FILE* f = str_is_null(out) ? stdout : fopen(out.ptr, "w");
+  if (f == NULL) {
+    fprintf(stderr, "[ERROR] Cannot write -out '%.*s'\n", SFMT(out));
+    return 1;
+  }
+  fprintf(f, "// Generated by tools/phf_gen from %.*s, do not edit.\n",
+          SFMT(in));
+  dstr_t guard = NULL;
+  for (usize i = 0; i < name.len; i++) dstr_append(&guard, name.ptr[i]);
+  str_t upper = {guard, arr_count(guard)};
+  str_to_uppercase(upper);
+  fprintf(f, "#ifndef %.*s_PHF_H_\n#define %.*s_PHF_H_\n\n", SFMT(upper),
+          SFMT(upper));
+  fprintf(f, "#include \"stdr_phf.h\"\n\n");
+
+  char buf[32];
+  usize column = 0;
+  fprintf(f, "static const u32 %.*s_phf_disp[%zu] = {\n", SFMT(name),
+          bucket_count);
+  for (usize b = 0; b < bucket_count; b++) {
+    snprintf(buf, sizeof(buf), "%u", disp[b]);
+    emit_item(f, &column, str(buf));
+  }
+  fprintf(f, "\n};\n\n");
+
+  fprintf(f, "static const char* const %.*s_phf_keys[%zu] = {\n", SFMT(name),
+          n);
+  column = 0;
+  for (usize i = 0; i < n; i++) {
+    dstr_t item = escape(keys[slots[i]]);
+    emit_item(f, &column, (str_t){item, arr_count(item)});
+    dstr_free(item);
+  }
+  fprintf(f, "\n};\n\n");
+
+  fprintf(f, "static const u32 %.*s_phf_lens[%zu] = {\n", SFMT(name), n);
+  column = 0;
+  for (usize i = 0; i < n; i++) {
+    snprintf(buf, sizeof(buf), "%zu", keys[slots[i]].len);
+    emit_item(f, &column, str(buf));
+  }
+  fprintf(f, "\n};\n\n");
+
+  fprintf(f, "[[maybe_unused]] static const phf_t %.*s_phf = {\n", SFMT(name));
+  fprintf(f, "    %zu, %zu, 0x%016llxull, %.*s_phf_disp, %.*s_phf_keys,\n",
+          n, bucket_count, (unsigned long long)seed, SFMT(name), SFMT(name));
+  fprintf(f, "    %.*s_phf_lens,\n", SFMT(name));
+  fprintf(f, "};\n\n#endif  // %.*s_PHF_H_\n", SFMT(upper));
+  dstr_free(guard);
+  if (f != stdout) fclose(f);
+
+  for (usize i = 0; i < n; i++) str_free(keys[i]);
+  arr_free(keys);
+  arr_free(content);
+  free(disp);
+  free(slots);
+  return 0;
+}